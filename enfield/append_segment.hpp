@@ -0,0 +1,142 @@
+//
+// file : append_segment.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 10:11:55 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <cstdint>
+#include <algorithm>
+
+namespace neam::enfield
+{
+  /// \brief Concurrent append-only array of pointers: insertions are lock-free (a single atomic increment in the common case)
+  /// Entries are stored in fixed-size chunks that are allocated on demand and never move,
+  /// so entries can be read (and reset) while other threads are appending.
+  /// \note Entries that are not yet published (or that have been reset) are nullptr
+  template<typename Type, uint32_t ChunkSize = 4096, uint32_t MaxChunkCount = 256>
+  class append_segment
+  {
+    public:
+      static constexpr uint32_t k_capacity = ChunkSize * MaxChunkCount;
+      static constexpr uint32_t k_invalid_index = ~0u;
+
+      append_segment() = default;
+      append_segment(const append_segment&) = delete;
+      append_segment& operator = (const append_segment&) = delete;
+
+      ~append_segment()
+      {
+        for (auto& it : chunks)
+          delete[] it.load(std::memory_order_acquire);
+      }
+
+      /// \brief Append an entry (thread safe, lock-free)
+      /// \return The index of the entry, or k_invalid_index if the segment is full
+      uint32_t push_back(Type* ptr)
+      {
+        const uint32_t index = reserve();
+        if (index != k_invalid_index)
+          publish(index, ptr);
+        return index;
+      }
+
+      /// \brief Reserve an entry, without publishing it (it stays nullptr until publish() is called)
+      /// Allows the entry to know its index before it can be seen by readers
+      /// \return The index of the entry, or k_invalid_index if the segment is full
+      uint32_t reserve()
+      {
+        const uint32_t index = reserved_count.fetch_add(1, std::memory_order_acq_rel);
+        if (index >= k_capacity)
+          return k_invalid_index;
+        return index;
+      }
+
+      /// \brief Publish a reserved entry (release: everything written to *ptr before is visible to the readers of the entry)
+      void publish(uint32_t index, Type* ptr)
+      {
+        get_or_create_chunk(index / ChunkSize)[index % ChunkSize].store(ptr, std::memory_order_release);
+      }
+
+      /// \brief Return the number of entries (including the ones not yet published and the reset ones)
+      uint32_t size() const
+      {
+        return std::min(reserved_count.load(std::memory_order_acquire), k_capacity);
+      }
+
+      /// \brief Return an entry (nullptr if not yet published or reset)
+      Type* get(uint32_t index) const
+      {
+        const std::atomic<Type*>* chunk = chunks[index / ChunkSize].load(std::memory_order_acquire);
+        if (chunk == nullptr)
+          return nullptr;
+        return chunk[index % ChunkSize].load(std::memory_order_acquire);
+      }
+
+      /// \brief Remove an entry (thread safe)
+      void reset(uint32_t index)
+      {
+        get_or_create_chunk(index / ChunkSize)[index % ChunkSize].store(nullptr, std::memory_order_release);
+      }
+
+      /// \brief Remove all the entries (the chunks are kept for the next insertions)
+      /// \warning Not thread safe
+      void clear()
+      {
+        const uint32_t count = size();
+        for (uint32_t i = 0; i < count; i += ChunkSize)
+        {
+          std::atomic<Type*>* chunk = chunks[i / ChunkSize].load(std::memory_order_acquire);
+          if (chunk == nullptr)
+            continue;
+          for (uint32_t j = 0; j < ChunkSize; ++j)
+            chunk[j].store(nullptr, std::memory_order_relaxed);
+        }
+        reserved_count.store(0, std::memory_order_release);
+      }
+
+    private:
+      std::atomic<Type*>* get_or_create_chunk(uint32_t chunk_index)
+      {
+        std::atomic<Type*>* chunk = chunks[chunk_index].load(std::memory_order_acquire);
+        if (chunk != nullptr)
+          return chunk;
+
+        std::atomic<Type*>* new_chunk = new std::atomic<Type*>[ChunkSize]();
+        if (chunks[chunk_index].compare_exchange_strong(chunk, new_chunk, std::memory_order_acq_rel))
+          return new_chunk;
+
+        // another thread was faster:
+        delete[] new_chunk;
+        return chunk;
+      }
+
+    private:
+      std::atomic<uint32_t> reserved_count = 0;
+      std::atomic<std::atomic<Type*>*> chunks[MaxChunkCount] = {};
+  };
+} // namespace neam::enfield
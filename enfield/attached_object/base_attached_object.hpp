@@ -230,6 +230,15 @@ namespace neam
             return ret;
           }
 
+          /// \brief Same as create_self(), but acquire the exclusive lock of the entity first
+          /// \note Used when creating attached objects from outside the construction of \e base (like lazy concepts)
+          template<attached_object::creation_flags Flags = attached_object::creation_flags::none, typename... DataProvider>
+          static FinalClass& create_self_locked(base_t& base, DataProvider&& ... provider)
+          {
+            std::lock_guard _lg(spinlock_exclusive_adapter::adapt(base.owner.lock));
+            return create_self<Flags>(base, std::forward<DataProvider>(provider)...);
+          }
+
           /// \brief Self destruct the attached object.
           /// This may not directly calls the destructor but instead flag the attached object to be destructed
           /// when there is no other object requiring it. This effectively bypass the externally_added flag.
@@ -175,6 +175,8 @@ namespace neam
           entity_data_t& owner;
 
           uint32_t index = 0;
+          // index in the active set of the type (see database::enable_active_set)
+          uint32_t active_index = ~0u;
 
         public:
           /// \brief The id of the type of the attached object
@@ -188,6 +190,8 @@ namespace neam
           bool automanaged : 1 = false;
           bool authorized_destruction : 1 = false;
           bool in_attached_object_db : 1 = false;
+          // in the immediate db of the type (see force_immediate_db_change), index is then the index in the immediate db
+          bool in_immediate_db : 1 = false;
 
           // If set to true, the attached-object will be fully transient.
           // A transient attached-object is not added to the attached_object_db,
@@ -199,7 +203,7 @@ namespace neam
           bool fully_transient_attached_object : 1 = false;
           // Cannot be set to true if fully_transient_attached_object is true.
           // An attached-object created with this flag to true will immediately be inserted in the attached-object db.
-          //  - creation will be slower, increasing lock contention
+          //  - creation is a bit slower (lock-free insertion in a separate segment, moved to the db on apply_component_db_changes)
           //  - queries, for-each, and some systems will be immediately aware of that attached-object
           //  - removal is still deferred, as this would impact for-each, systems and queries
           bool force_immediate_db_change : 1 = false;
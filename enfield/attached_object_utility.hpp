@@ -51,9 +51,9 @@ namespace neam::enfield
       type_t attached_object_id = ~type_t(0);
       size_t min_count = ~0ul;
       (
-        ((db.attached_object_db[id_t<AttachedObjects>::id()].db.size() < min_count) ?
+        ((db.get_attached_object_count(id_t<AttachedObjects>::id()) < min_count) ?
          (
-           min_count = db.attached_object_db[id_t<AttachedObjects>::id()].db.size(),
+           min_count = db.get_attached_object_count(id_t<AttachedObjects>::id()),
            attached_object_id = id_t<AttachedObjects>::id(),
            0
          ) : 0), ...
@@ -91,6 +91,12 @@ namespace neam::enfield
       const database_t& db;
     };
 
+    /// \brief Assert that the lazy attached object types have been materialized (see database::materialize)
+    static void check_materialized([[maybe_unused]] const database_t& db)
+    {
+      (check::debug::n_assert(db.is_materialized(id_t<AttachedObjects>::id()), "lazy attached object type has not been materialized (see database::materialize)"), ...);
+    }
+
     static inline_mask<DatabaseConf> make_mask()
     {
       inline_mask<DatabaseConf> mask;
@@ -49,6 +49,10 @@ namespace neam
     /// The core utility of a concept is the same core utility an abstract class may have in C++
     /// Please refer to the concepts provided in the samples on the proper way to implement / use them.
     /// \note The proper way to provide concepts is via CRTP so as to encapsulate the boilerplate in the parent class
+    /// \note A concept can opt into lazy materialization by defining `static constexpr bool lazy_materialization = true;`
+    ///       Providers of such concepts only record themselves (no attached object is created) until the concept
+    ///       is used by a system (see system_manager::add_system) or explicitly materialized with database::materialize<ConceptType>()
+    ///       (for-each and queries assert that the concept has been materialized)
     template<typename DatabaseConf, typename ConceptType>
     class ecs_concept : public attached_object::base_tpl<DatabaseConf, typename DatabaseConf::concept_class, ConceptType, attached_object::creation_flags::force_immediate_changes>
     {
@@ -62,24 +66,94 @@ namespace neam
       protected:
         using base_t = attached_object::base<DatabaseConf>;
 
+        /// \brief Database-wide list of the concept providers of a single concrete type
+        /// This allows concepts to process all the providers of a type in a single monomorphic loop (no virtual call per provider),
+        /// instead of going entity by entity. (see the auto_updatable sample)
+        template<typename ConceptLogic>
+        struct provider_group_t
+        {
+          mutable shared_spinlock lock;
+          std::vector<ConceptLogic*> providers;
+          bool has_been_used = false;
+        };
+
+        /// \brief Return the provider group of ConceptLogic (a class inheriting from ConceptType::concept_logic)
+        template<typename ConceptLogic>
+        static provider_group_t<ConceptLogic>& get_provider_group(database<DatabaseConf>& db)
+        {
+          return db.template get_shared_object<provider_group_t<ConceptLogic>>();
+        }
+
+        class base_concept_logic;
+
+        /// \brief Database-wide bookkeeping of the providers of a lazy concept that has not been materialized yet
+        struct lazy_state_t
+        {
+          mutable shared_spinlock lock;
+          std::vector<base_concept_logic*> pending_providers;
+        };
+
+        static constexpr bool is_lazy()
+        {
+          if constexpr (requires { ConceptType::lazy_materialization; })
+            return ConceptType::lazy_materialization;
+          else
+            return false;
+        }
+
         /// \brief Implement the register / unregister thing
         class base_concept_logic
         {
           public:
             virtual ~base_concept_logic()
             {
-              auto it = std::remove(ecs_concept.concept_providers.begin(), ecs_concept.concept_providers.end(), this);
-              ecs_concept.concept_providers.erase(it, ecs_concept.concept_providers.end());
-              if (ecs_concept.concept_providers.empty())
-                ecs_concept.self_destruct();
+              if constexpr (is_lazy())
+              {
+                if (ecs_concept == nullptr)
+                {
+                  // never materialized: only remove the bookkeeping
+                  lazy_state_t& state = base.get_database().template get_shared_object<lazy_state_t>();
+                  std::lock_guard _lg(spinlock_exclusive_adapter::adapt(state.lock));
+                  check::debug::n_assert(pending_index < state.pending_providers.size() && state.pending_providers[pending_index] == this,
+                                         "Incoherent lazy concept state (was the concept materialized concurrently with the destruction of a provider?)");
+
+                  // swap-remove:
+                  state.pending_providers[pending_index] = state.pending_providers.back();
+                  state.pending_providers[pending_index]->pending_index = pending_index;
+                  state.pending_providers.pop_back();
+                  return;
+                }
+              }
+
+              auto it = std::remove(ecs_concept->concept_providers.begin(), ecs_concept->concept_providers.end(), this);
+              ecs_concept->concept_providers.erase(it, ecs_concept->concept_providers.end());
+              if (ecs_concept->concept_providers.empty())
+                ecs_concept->self_destruct();
             }
 
           protected:
             template<typename... Types>
             base_concept_logic(base_t& _base, Types&&... types)
-              : ecs_concept(ecs_concept::create_self(_base, std::forward<Types>(types)...)), base(_base)
+              : base(_base)
             {
-              ecs_concept.concept_providers.push_back(this);
+              if constexpr (is_lazy())
+              {
+                static_assert(sizeof...(Types) == 0, "Lazy concepts cannot be constructed with parameters");
+
+                database<DatabaseConf>& db = base.get_database();
+                lazy_state_t& state = db.template get_shared_object<lazy_state_t>();
+                std::lock_guard _lg(spinlock_exclusive_adapter::adapt(state.lock));
+                if (db.set_lazy_materializer(type_id<ConceptType, typename DatabaseConf::attached_object_type>::id(), &base_concept_logic::materialize_pending_providers))
+                {
+                  pending_index = (uint32_t)state.pending_providers.size();
+                  state.pending_providers.push_back(this);
+                  return;
+                }
+                // already requested: the concept is created right away
+              }
+
+              ecs_concept = &ecs_concept::create_self(_base, std::forward<Types>(types)...);
+              ecs_concept->concept_providers.push_back(this);
             }
 
           protected:
@@ -96,13 +170,78 @@ namespace neam
             const base_t& get_base() const { return base; }
 
             /// \brief Return the concept class
-            ConceptType& get_concept() { return ecs_concept; }
+            /// \note For lazy concepts, the concept must have been materialized
+            ConceptType& get_concept()
+            {
+              check::debug::n_assert(ecs_concept != nullptr, "get_concept: the lazy concept has not been materialized yet");
+              return *ecs_concept;
+            }
             /// \brief Return the concept class
-            const ConceptType& get_concept() const { return ecs_concept; }
+            const ConceptType& get_concept() const
+            {
+              check::debug::n_assert(ecs_concept != nullptr, "get_concept: the lazy concept has not been materialized yet");
+              return *ecs_concept;
+            }
+
+            /// \brief Return whether the concept has been created for this provider (always true for non-lazy concepts)
+            bool is_concept_materialized() const { return ecs_concept != nullptr; }
+
+            /// \brief Add the provider to the group of its concrete type (see provider_group_t)
+            /// Should be called in the constructor of the final concept_logic class, with remove_from_provider_group in its destructor
+            /// \return true if this is the first time a provider is added to that group (so the concept can register the group)
+            template<typename ConceptLogic>
+            bool add_to_provider_group(ConceptLogic& self)
+            {
+              provider_group_t<ConceptLogic>& group = get_provider_group<ConceptLogic>(base.get_database());
+              std::lock_guard _lg(spinlock_exclusive_adapter::adapt(group.lock));
+              provider_group_index = group.providers.size();
+              group.providers.push_back(&self);
+
+              const bool is_first = !group.has_been_used;
+              group.has_been_used = true;
+              return is_first;
+            }
+
+            template<typename ConceptLogic>
+            void remove_from_provider_group(ConceptLogic& self)
+            {
+              provider_group_t<ConceptLogic>& group = get_provider_group<ConceptLogic>(base.get_database());
+              std::lock_guard _lg(spinlock_exclusive_adapter::adapt(group.lock));
+              check::debug::n_assert(group.providers[provider_group_index] == &self, "Incoherent provider group state");
+
+              // swap-remove:
+              group.providers[provider_group_index] = group.providers.back();
+              group.providers[provider_group_index]->provider_group_index = provider_group_index;
+              group.providers.pop_back();
+            }
 
           private:
-            ConceptType& ecs_concept;
+            /// \brief Create the concept on all the pending providers (registered as the lazy materializer in the database)
+            static void materialize_pending_providers(database<DatabaseConf>& db)
+            {
+              TRACY_SCOPED_ZONE;
+              std::vector<base_concept_logic*> pending;
+              {
+                lazy_state_t& state = db.template get_shared_object<lazy_state_t>();
+                std::lock_guard _lg(spinlock_exclusive_adapter::adapt(state.lock));
+                pending.swap(state.pending_providers);
+              }
+
+              for (base_concept_logic* it : pending)
+              {
+                it->pending_index = k_not_pending;
+                it->ecs_concept = &ecs_concept::create_self_locked(it->base);
+                it->ecs_concept->concept_providers.push_back(it);
+              }
+            }
+
+          private:
+            static constexpr uint32_t k_not_pending = ~0u;
+
+            ConceptType* ecs_concept = nullptr;
             base_t& base;
+            uint32_t provider_group_index = 0;
+            uint32_t pending_index = k_not_pending;
             friend ConceptType;
         };
 
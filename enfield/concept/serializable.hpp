@@ -27,9 +27,17 @@
 #pragma once
 
 #include <map>
+#include <span>
+#include <cstring>
+#include <concepts>
+#include <thread>
+#include <vector>
+#include <algorithm>
+#include <unordered_map>
 
 #include "concept.hpp"
 #include "../component/component.hpp"
+#include "../mapped_file.hpp"
 
 #include <ntools/raw_data.hpp>
 #include <ntools/struct_metadata/struct_metadata.hpp>
@@ -40,11 +48,263 @@ namespace neam::enfield::concepts
 {
   namespace internal
   {
+    /// \brief v1 format of serializable::serialize() (still read by refresh / deserialize)
     struct serialized_entity
     {
       std::vector<uint64_t> externally_added_components;
       std::map<uint64_t, raw_data> serialized_components;
     };
+
+    /// \brief v2 format of serializable::serialize(): the header is followed by component_count entries
+    /// (sorted by type hash), then by the payloads of all the components in a single contiguous block
+    /// \note The format is native (endianness)
+    struct flat_serialized_entity_header
+    {
+      static constexpr uint64_t k_magic = 0x3256455346464E45; // ENFFSEV2
+
+      uint64_t magic = k_magic;
+      uint32_t component_count = 0;
+      uint32_t _padding = 0;
+    };
+
+    struct flat_serialized_entity_entry
+    {
+      uint64_t type_hash;
+      uint32_t offset; // from the start of the payload block
+      uint32_t size;
+      uint32_t externally_added;
+      uint32_t _padding = 0;
+    };
+
+    inline bool is_flat_serialized_entity(const raw_data& data)
+    {
+      uint64_t magic;
+      if (data.size < sizeof(flat_serialized_entity_header))
+        return false;
+      std::memcpy(&magic, data.data.get(), sizeof(magic));
+      return magic == flat_serialized_entity_header::k_magic;
+    }
+
+    /// \brief Open-addressing hash table, indexed by type hashes (which are already hashes, and never 0)
+    template<typename Value>
+    class type_hash_table
+    {
+      public:
+        void insert(uint64_t key, Value value)
+        {
+          if ((count + 1) * 2 > slots.size())
+          {
+            std::vector<slot_t> old_slots = std::move(slots);
+            slots.clear();
+            slots.resize(std::max<size_t>(16, old_slots.size() * 2));
+            count = 0;
+            for (slot_t& it : old_slots)
+            {
+              if (it.key != 0)
+                insert_slot(it.key, std::move(it.value));
+            }
+          }
+          insert_slot(key, std::move(value));
+        }
+
+        const Value* find(uint64_t key) const
+        {
+          if (slots.empty())
+            return nullptr;
+          for (size_t i = key & (slots.size() - 1);; i = (i + 1) & (slots.size() - 1))
+          {
+            if (slots[i].key == key)
+              return &slots[i].value;
+            if (slots[i].key == 0)
+              return nullptr;
+          }
+        }
+
+        bool contains(uint64_t key) const { return find(key) != nullptr; }
+
+      private:
+        void insert_slot(uint64_t key, Value&& value)
+        {
+          for (size_t i = key & (slots.size() - 1);; i = (i + 1) & (slots.size() - 1))
+          {
+            if (slots[i].key == key)
+            {
+              slots[i].value = std::move(value);
+              return;
+            }
+            if (slots[i].key == 0)
+            {
+              slots[i] = { key, std::move(value) };
+              ++count;
+              return;
+            }
+          }
+        }
+
+      private:
+        struct slot_t
+        {
+          uint64_t key = 0;
+          Value value = {};
+        };
+        std::vector<slot_t> slots;
+        size_t count = 0;
+    };
+
+    /// \brief The serialized data of a component, as seen by the deserialization
+    struct persistent_component
+    {
+      uint64_t type_hash;
+      const raw_data* data; // rle encoded data (nullptr when the data is in pod_data or rle_data)
+      bool externally_added;
+      std::span<const uint8_t> pod_data = {}; // raw data of trivially copyable components (see serializable::mapped_snapshot)
+      std::span<const uint8_t> rle_data = {}; // rle encoded data, in a larger buffer (see flat_serialized_entity_header)
+      bool unchanged = false; // present, but has not changed since the baseline: there's no data (see serializable::serialize_delta)
+
+      /// \brief false for the components that are present but have not changed (see serializable::serialize_delta)
+      bool has_data() const { return !unchanged; }
+      /// \brief Whether the data is rle encoded (it may be empty, if the attached object serialized to nothing)
+      bool has_rle_data() const { return !unchanged && pod_data.empty(); }
+
+      /// \brief Scoped access to the rle encoded data of a component (see get_rle_data())
+      class rle_data_ref
+      {
+        public:
+          rle_data_ref(const raw_data& _data, bool* _in_use = nullptr) : data(_data), in_use(_in_use) {}
+          rle_data_ref(const rle_data_ref&) = delete;
+          rle_data_ref& operator = (const rle_data_ref&) = delete;
+          ~rle_data_ref()
+          {
+            if (in_use != nullptr)
+              *in_use = false;
+          }
+
+          const raw_data& get() const { return data; }
+
+        private:
+          const raw_data& data;
+          bool* in_use;
+      };
+
+      /// \brief Return the rle encoded data
+      /// \note For views, the data is copied in a per-thread buffer that is reused across calls,
+      ///       so the returned object must not outlive the decoding of the data, and only one can exist per thread at a time
+      ///       (asserted: an attached object cannot trigger the deserialization of another one while its data is being decoded)
+      rle_data_ref get_rle_data() const
+      {
+        if (data != nullptr)
+          return { *data };
+
+        thread_local raw_data buffer;
+        thread_local size_t buffer_capacity = 0;
+        thread_local bool is_buffer_in_use = false;
+        check::debug::n_assert(!is_buffer_in_use, "persistent_component::get_rle_data(): nested use of the per-thread buffer (re-entrant deserialization)");
+        is_buffer_in_use = true;
+
+        if (buffer_capacity < rle_data.size())
+        {
+          buffer_capacity = std::max(rle_data.size(), buffer_capacity * 2);
+          buffer = raw_data::allocate(buffer_capacity);
+        }
+        if (!rle_data.empty())
+          std::memcpy(buffer.data.get(), rle_data.data(), rle_data.size());
+        buffer.size = rle_data.size();
+        return { buffer, &is_buffer_in_use };
+      }
+    };
+
+    /// \brief The serialized components of the entity being deserialized
+    struct persistent_data
+    {
+      std::span<const persistent_component> components; // sorted by type_hash
+
+      const persistent_component* find(uint64_t type_hash) const
+      {
+        auto it = std::lower_bound(components.begin(), components.end(), type_hash, [](const persistent_component& a, uint64_t b)
+        {
+          return a.type_hash < b;
+        });
+        if (it == components.end() || it->type_hash != type_hash)
+          return nullptr;
+        return &*it;
+      }
+    };
+
+    /// \brief Components of an entity that changed since the last serialize_delta()
+    struct serialized_entity_delta
+    {
+      std::vector<uint64_t> externally_added_components;
+      std::vector<uint64_t> unchanged_components; // present, but not changed since the baseline
+      std::map<uint64_t, raw_data> changed_components;
+    };
+
+    /// \brief FNV-1a, used to detect changes in the serialized data
+    inline uint64_t hash_data(std::span<const uint8_t> data)
+    {
+      uint64_t hash = 0xcbf29ce484222325;
+      for (const uint8_t it : data)
+        hash = (hash ^ it) * 0x100000001b3;
+      // 0 is reserved for "no baseline"
+      return hash != 0 ? hash : 1;
+    }
+
+    /// \brief All the components of a given type in a database snapshot
+    struct snapshot_column
+    {
+      std::vector<uint32_t> entity_indices; // sorted, index of the owner in the snapshot
+      std::vector<uint8_t> externally_added;
+      std::vector<raw_data> payloads;
+    };
+
+    /// \brief Type-grouped serialized data of a whole database
+    struct database_snapshot
+    {
+      uint32_t entity_count = 0;
+      std::vector<uint64_t> type_hashes; // sorted, one per column
+      std::vector<snapshot_column> columns;
+    };
+
+    /// \brief Header of a mapped snapshot (see serializable::mapped_snapshot)
+    /// Followed by column_count mapped_snapshot_column
+    struct mapped_snapshot_header
+    {
+      static constexpr uint64_t k_magic = 0x50414E5344464E45; // ENFDSNAP
+      static constexpr uint32_t k_version = 1;
+      static constexpr uint64_t k_alignment = 4096;
+
+      uint64_t magic = k_magic;
+      uint32_t version = k_version;
+      uint32_t entity_count = 0;
+      uint32_t column_count = 0;
+      uint32_t _padding = 0;
+
+      // the database_snapshot holding the components that aren't trivially copyable
+      uint64_t rle_offset = 0;
+      uint64_t rle_size = 0;
+    };
+
+    /// \brief A column of trivially copyable components in a mapped snapshot
+    /// \note Offsets are from the start of the snapshot. data_offset is aligned on mapped_snapshot_header::k_alignment
+    struct mapped_snapshot_column
+    {
+      uint64_t type_hash;
+      uint64_t element_size;
+      uint64_t element_count;
+      uint64_t entity_indices_offset; // uint32_t[element_count], sorted
+      uint64_t externally_added_offset; // uint8_t[element_count]
+      uint64_t data_offset; // element_size * element_count bytes
+    };
+
+    /// \brief A column of either a database_snapshot or a mapped snapshot
+    struct column_view
+    {
+      uint64_t type_hash;
+      std::span<const uint32_t> entity_indices;
+      std::span<const uint8_t> externally_added;
+      std::span<const raw_data> payloads; // rle encoded columns
+      std::span<const uint8_t> pod_data; // trivially copyable columns
+      uint64_t element_size = 0;
+    };
   }
 
   /// \brief Define a serializable concept that uses RLE
@@ -78,10 +338,15 @@ namespace neam::enfield::concepts
           virtual uint64_t _get_type_hash() const = 0;
           virtual void _do_refresh_serializable_data() = 0;
           virtual void _do_remove(entity<DatabaseConf>& entity) = 0;
+          /// \brief Return the raw data of the attached object, if it can be copied as-is (empty otherwise)
+          virtual std::span<const uint8_t> _get_pod_data() const = 0;
 
         private:
           bool _is_externally_added() const { return this->get_base().is_externally_added(); }
 
+          // hash of the data sent in the last delta (see serialize_delta)
+          uint64_t delta_baseline_hash = 0;
+
           friend class serializable<DatabaseConf>;
       };
 
@@ -106,8 +371,8 @@ namespace neam::enfield::concepts
             auto* ptr = this->get_concept().persistent_data;
             if (ptr)
             {
-              const ConceptProvider& base = this->template get_base_as<ConceptProvider>();
-              return ptr->serialized_components.end() != ptr->serialized_components.find(base.object_type_id);
+              const internal::persistent_component* component = ptr->find(ct::type_hash<ConceptProvider>);
+              return component != nullptr && component->has_data();
             }
             return false;
           }
@@ -123,12 +388,13 @@ namespace neam::enfield::concepts
             auto* data = this->get_concept().persistent_data;
             check::debug::n_assert(data != nullptr, "get_persistent_data() called outside deserialization");
 
-            const ConceptProvider& base = this->template get_base_as<ConceptProvider>();
-            const auto& it = data->serialized_components.find(base._get_type_hash());
-            check::debug::n_assert(it != data->serialized_components.end(), "get_persistent_data(): no data found for concept provider");
+            const internal::persistent_component* component = data->find(ct::type_hash<ConceptProvider>);
+            check::debug::n_assert(component != nullptr && component->has_rle_data(), "get_persistent_data(): no data found for concept provider");
 
             rle::status rle_st = rle::status::success;
-            rle::decoder dc = it->second;
+            // the data may be in a per-thread buffer: it is only valid (and decoded) in this scope
+            const internal::persistent_component::rle_data_ref rle_data = component->get_rle_data();
+            rle::decoder dc = rle_data.get();
             data_t ret = rle::coder<data_t>::decode(dc, rle_st);
             if (rle_st == rle::status::failure)
               check::debug::n_assert(false, "get_persistent_data(): failed to decode the data");
@@ -136,6 +402,26 @@ namespace neam::enfield::concepts
           }
 
         private:
+          /// \brief Whether the attached object holds a trivially copyable data member (like data_holder)
+          /// Such attached objects are written as-is in mapped snapshots
+          /// \note Only the data member is copied, so pointers are not remapped
+          static constexpr bool is_pod_provider()
+          {
+            if constexpr (metadata::concepts::StructWithMetadata<ConceptProvider>
+                          && requires(const ConceptProvider& p) { { p.data } -> std::same_as<const typename ConceptProvider::data_t&>; })
+              return std::is_trivially_copyable_v<typename ConceptProvider::data_t>;
+            else
+              return false;
+          }
+
+          static size_t get_pod_size()
+          {
+            if constexpr (is_pod_provider())
+              return sizeof(typename ConceptProvider::data_t);
+            else
+              return 0;
+          }
+
           raw_data _do_serialize(rle::status& st) final override
           {
             ConceptProvider& base = this->template get_base_as<ConceptProvider>();
@@ -155,19 +441,49 @@ namespace neam::enfield::concepts
             return ct::type_hash<ConceptProvider>;
           }
 
+          std::span<const uint8_t> _get_pod_data() const final override
+          {
+            if constexpr (is_pod_provider())
+            {
+              const ConceptProvider& base = this->template get_base_as<ConceptProvider>();
+              return { reinterpret_cast<const uint8_t*>(&base.data), sizeof(base.data) };
+            }
+            else
+            {
+              return {};
+            }
+          }
+
           void _do_refresh_serializable_data() final override
           {
             if constexpr (metadata::concepts::StructWithMetadata<ConceptProvider>)
             {
               // We can deserialize in-place
-              const internal::serialized_entity* data = this->get_concept().persistent_data;
+              const internal::persistent_data* data = this->get_concept().persistent_data;
               check::debug::n_assert(data != nullptr, "get_persistent_data() called outside deserialization");
 
               ConceptProvider& base = this->template get_base_as<ConceptProvider>();
-              const auto& it = data->serialized_components.find(base._get_type_hash());
-              check::debug::n_assert(it != data->serialized_components.end(), "get_persistent_data(): no data found for concept provider");
+              const internal::persistent_component* component = data->find(ct::type_hash<ConceptProvider>);
+              check::debug::n_assert(component != nullptr, "get_persistent_data(): no data found for concept provider");
 
-              rle::status rle_st = rle::in_place_deserialize(it->second, base);
+              // unchanged since the delta baseline: nothing to do
+              if (!component->has_data())
+                return;
+
+              if constexpr (is_pod_provider())
+              {
+                if (!component->pod_data.empty())
+                {
+                  // raw data (from a mapped snapshot): simply copy it
+                  check::debug::n_assert(component->pod_data.size() == sizeof(base.data), "get_persistent_data(): invalid data size");
+                  std::memcpy(&base.data, component->pod_data.data(), sizeof(base.data));
+                  return;
+                }
+              }
+              check::debug::n_assert(component->has_rle_data(), "get_persistent_data(): no data found for concept provider");
+
+              // the data may be in a per-thread buffer, only valid until the end of the decoding
+              rle::status rle_st = rle::in_place_deserialize(component->get_rle_data().get(), base);
               if (rle_st == rle::status::failure)
                 check::debug::n_check(false, "get_persistent_data(): failed to decode the data");
             }
@@ -184,7 +500,7 @@ namespace neam::enfield::concepts
           }
 
           /// \brief Perform the require in the name of serializable<>
-          static void require_concept_provider(serializable&, entity<DatabaseConf>& entity)
+          static void require_concept_provider(entity<DatabaseConf>& entity)
           {
             concept_provider<ConceptProvider>& base = entity.template add<ConceptProvider>();
             if constexpr(metadata::concepts::StructWithMetadata<ConceptProvider>)
@@ -194,6 +510,14 @@ namespace neam::enfield::concepts
             }
           };
 
+          /// \brief Externally add the attached object, without any data (see serializable::add_by_type_hash())
+          static void add_concept_provider(entity<DatabaseConf>& entity)
+          {
+            const ConceptProvider* object = entity.template get<ConceptProvider>();
+            if (object == nullptr || !object->is_externally_added())
+              entity.template add<ConceptProvider>();
+          }
+
           /// \brief Only here for the automatic registration of the type
           static int _dummy_;
 
@@ -229,6 +553,11 @@ namespace neam::enfield::concepts
             return ct::type_hash<deserialization_marker>;
           }
 
+          std::span<const uint8_t> _get_pod_data() const final override
+          {
+            return {};
+          }
+
           void _do_remove(entity<DatabaseConf>& ) final override
           {
             // Cannot remove as we very probably are still in the constructor
@@ -241,34 +570,57 @@ namespace neam::enfield::concepts
     public:
       /// \brief standard enfield constructor
       /// \note the constructor actually performs the deserialization
-      serializable(typename ecs_concept::param_t p) : ecs_concept(p)
+      serializable(typename ecs_concept::param_t p) : ecs_concept(p), persistent_data(new_entity_persistent_data)
       {
       }
 
       /// \brief Return the serialized data for the serializable attached objects of that entity
+      /// \note The output is in the flat (v2) format: a sorted type-hash table followed by all the payloads in a single block
       raw_data serialize(rle::status& st)
       {
-        internal::serialized_entity serialized_data;
+        bool has_externally_added_components = false;
         for (size_t i = 0; i < this->get_concept_providers_count(); ++i)
-        {
-          if (this->get_concept_provider(i)._is_externally_added())
-          {
-            serialized_data.externally_added_components.push_back(this->get_concept_provider(i)._get_type_hash());
-          }
-        }
+          has_externally_added_components = has_externally_added_components || this->get_concept_provider(i)._is_externally_added();
 
-        if (serialized_data.externally_added_components.empty())
+        if (!has_externally_added_components)
         {
           st = rle::status::failure;
           return {};
         }
 
+        struct component_t
+        {
+          uint64_t type_hash;
+          bool externally_added;
+          raw_data payload;
+        };
+        std::vector<component_t> components;
+        components.reserve(this->get_concept_providers_count());
+        size_t payload_size = 0;
         for (size_t i = 0; i < this->get_concept_providers_count(); ++i)
         {
-          serialized_data.serialized_components.emplace(this->get_concept_provider(i)._get_type_hash(), this->get_concept_provider(i)._do_serialize(st));
+          concept_logic& provider = this->get_concept_provider(i);
+          components.push_back({ provider._get_type_hash(), provider._is_externally_added(), provider._do_serialize(st) });
+          payload_size += components.back().payload.size;
         }
+        std::sort(components.begin(), components.end(), [](const component_t& a, const component_t& b) { return a.type_hash < b.type_hash; });
+
+        internal::flat_serialized_entity_header header;
+        header.component_count = (uint32_t)components.size();
+        const size_t payload_offset = sizeof(header) + components.size() * sizeof(internal::flat_serialized_entity_entry);
 
-        return rle::serialize(serialized_data, &st);
+        raw_data ret = raw_data::allocate(payload_offset + payload_size);
+        uint8_t* const ptr = reinterpret_cast<uint8_t*>(ret.data.get());
+        std::memcpy(ptr, &header, sizeof(header));
+        uint32_t offset = 0;
+        for (uint32_t i = 0; i < components.size(); ++i)
+        {
+          const internal::flat_serialized_entity_entry entry { components[i].type_hash, offset, (uint32_t)components[i].payload.size, components[i].externally_added ? 1u : 0u };
+          std::memcpy(ptr + sizeof(header) + i * sizeof(entry), &entry, sizeof(entry));
+          std::memcpy(ptr + payload_offset + offset, components[i].payload.data.get(), components[i].payload.size);
+          offset += (uint32_t)components[i].payload.size;
+        }
+        return ret;
       }
 
       /// \brief Create a new entity and deserialize the attached objects from the raw data
@@ -289,38 +641,741 @@ namespace neam::enfield::concepts
       /// \brief Update an entity from raw data
       /// \note attached objects that aren't present in the data_map will be removed (unless there's dependencies)
       ///       attached objects that are present in the data_map but not in the entity will be created
+      /// \note Both the flat (v2) and the v1 formats are supported
       void refresh(entity<DatabaseConf>& entity, const raw_data& data, rle::status& st)
       {
-        deserialize(entity, rle::deserialize<internal::serialized_entity>(data, &st));
+        internal::serialized_entity v1_storage;
+        std::vector<internal::persistent_component> components;
+        if (!get_components(data, v1_storage, components, st))
+          return;
+        deserialize(entity, internal::persistent_data{components});
+      }
+
+      /// \brief Serialize multiple entities, split across multiple tasks
+      /// \param output Resized to the number of entities. Entities that cannot be serialized have an empty raw_data.
+      ///               Must stay valid until the returned task has completed.
+      /// \return The final task (\e output is only complete when that task has run)
+      /// \warning The entities must not be modified while the tasks are in flight
+      static threading::task_wrapper serialize_batch(threading::task_manager& tm, threading::group_t group_id,
+                                                     std::span<entity<DatabaseConf>> entities, std::vector<raw_data>& output)
+      {
+        output.clear();
+        output.resize(entities.size());
+        return dispatch_batch(tm, group_id, entities.size(), [entities, &output](size_t i)
+        {
+          std::lock_guard _lg(spinlock_shared_adapter::adapt(entities[i].get_lock()));
+          serializable* concept_ptr = entities[i].template get<serializable>();
+          if (concept_ptr == nullptr)
+            return;
+
+          rle::status st = rle::status::success;
+          raw_data data = concept_ptr->serialize(st);
+          if (st != rle::status::failure)
+            output[i] = std::move(data);
+        });
+      }
+
+      /// \brief Create one entity per serialized data (see serialize()), and deserialize them across multiple tasks
+      /// The entities are created at once (before the tasks are dispatched) and are deserialized without any deserialization_marker.
+      /// \param data The serialized entities. Must stay valid until the returned task has completed.
+      /// \param entities Set to the created entities (in the same order as \e data). Entities whose data is invalid are left empty.
+      /// \return The final task (the entities are only complete when that task has run)
+      static threading::task_wrapper deserialize_batch(threading::task_manager& tm, threading::group_t group_id, database<DatabaseConf>& db,
+                                                       std::span<const raw_data> data, std::vector<entity<DatabaseConf>>& entities)
+      {
+        entities = db.create_entities(data.size());
+        return dispatch_batch(tm, group_id, data.size(), [data, &entities](size_t i)
+        {
+          rle::status st = rle::status::success;
+          internal::serialized_entity v1_storage;
+          std::vector<internal::persistent_component> components;
+          if (!get_components(data[i], v1_storage, components, st))
+            return;
+
+          std::lock_guard _lg(spinlock_exclusive_adapter::adapt(entities[i].get_lock()));
+          deserialize_entity(entities[i], internal::persistent_data{components});
+        });
+      }
+
+      /// \brief Return the serialized data of the attached objects that changed since the last call (the baseline)
+      /// The first call (or the first one after reset_delta_baseline()) returns all the attached objects.
+      /// \note Changes are detected by hashing the serialized data (or the raw data for trivially copyable attached objects,
+      ///       in which case unchanged attached objects are not serialized at all)
+      /// \note The baseline is updated by this call (unless it fails), so the delta must be applied (see apply_delta) before the next one
+      /// \return an empty raw_data if nothing has changed
+      raw_data serialize_delta(rle::status& st)
+      {
+        TRACY_SCOPED_ZONE;
+        internal::serialized_entity_delta delta;
+        bool has_changes = this->get_concept_providers_count() != delta_baseline_provider_count;
+
+        // the baseline is only updated once the delta has been successfully serialized
+        std::vector<std::pair<concept_logic*, uint64_t>> new_baseline_hashes;
+
+        for (size_t i = 0; i < this->get_concept_providers_count(); ++i)
+        {
+          concept_logic& provider = this->get_concept_provider(i);
+          const uint64_t type_hash = provider._get_type_hash();
+          if (provider._is_externally_added())
+            delta.externally_added_components.push_back(type_hash);
+
+          const std::span<const uint8_t> pod_data = provider._get_pod_data();
+          raw_data payload;
+          uint64_t hash;
+          if (!pod_data.empty())
+          {
+            hash = internal::hash_data(pod_data);
+          }
+          else
+          {
+            payload = provider._do_serialize(st);
+            hash = internal::hash_data({ reinterpret_cast<const uint8_t*>(payload.data.get()), payload.size });
+          }
+
+          if (hash == provider.delta_baseline_hash)
+          {
+            delta.unchanged_components.push_back(type_hash);
+            continue;
+          }
+
+          has_changes = true;
+          new_baseline_hashes.emplace_back(&provider, hash);
+          if (!pod_data.empty())
+            payload = provider._do_serialize(st);
+          delta.changed_components.emplace(type_hash, std::move(payload));
+        }
+
+        if (delta.externally_added_components.empty())
+        {
+          st = rle::status::failure;
+          return {};
+        }
+        if (st == rle::status::failure)
+          return {};
+        if (!has_changes)
+          return {};
+
+        raw_data ret = rle::serialize(delta, &st);
+        if (st == rle::status::failure)
+          return {};
+
+        delta_baseline_provider_count = this->get_concept_providers_count();
+        for (const auto& it : new_baseline_hashes)
+          it.first->delta_baseline_hash = it.second;
+        return ret;
+      }
+
+      /// \brief Make the next serialize_delta() return all the attached objects
+      void reset_delta_baseline()
+      {
+        delta_baseline_provider_count = ~size_t(0);
+        this->for_each_concept_provider([](concept_logic& prov) { prov.delta_baseline_hash = 0; });
+      }
+
+      /// \brief Update an entity from a delta. Works like refresh(): the attached objects that are not in the delta are removed.
+      /// Unchanged attached objects are left untouched.
+      /// \note Fails (without changing the entity) if an attached object marked as unchanged is not present on the entity
+      void apply_delta(entity<DatabaseConf>& entity, const raw_data& data, rle::status& st)
+      {
+        if (data.size == 0)
+          return;
+        const internal::serialized_entity_delta delta = rle::deserialize<internal::serialized_entity_delta>(data, &st);
+        if (st == rle::status::failure)
+          return;
+
+        for (uint64_t type_hash : delta.unchanged_components)
+        {
+          bool is_present = false;
+          for (size_t i = 0; i < this->get_concept_providers_count() && !is_present; ++i)
+            is_present = this->get_concept_provider(i)._get_type_hash() == type_hash;
+          if (!is_present)
+          {
+            // the delta was made against a baseline this entity does not have
+            st = rle::status::failure;
+            return;
+          }
+        }
+
+        std::vector<internal::persistent_component> components;
+        get_delta_components(delta, components);
+        deserialize(entity, internal::persistent_data{components});
+      }
+
+      /// \brief Create a new entity from a full delta (the first serialize_delta() of an entity)
+      static entity<DatabaseConf> deserialize_delta(database<DatabaseConf>& db, const raw_data& data, rle::status& st)
+      {
+        entity<DatabaseConf> entity = db.create_entity();
+        std::lock_guard _lg(spinlock_exclusive_adapter::adapt(entity.get_lock()));
+        deserialize_delta(entity, data, st);
+        return entity;
+      }
+
+      /// \brief Deserialize a full delta on an entity that does not have any serializable attached object
+      /// (for entities that have some, use apply_delta())
+      /// \note Fails if the delta is not a full one (it has attached objects marked as unchanged)
+      static void deserialize_delta(entity<DatabaseConf>& entity, const raw_data& data, rle::status& st)
+      {
+        const internal::serialized_entity_delta delta = rle::deserialize<internal::serialized_entity_delta>(data, &st);
+        if (st == rle::status::failure)
+          return;
+        if (!delta.unchanged_components.empty())
+        {
+          st = rle::status::failure;
+          return;
+        }
+
+        std::vector<internal::persistent_component> components;
+        get_delta_components(delta, components);
+        deserialize_entity(entity, internal::persistent_data{components});
+      }
+
+      /// \brief Serialize all the entities of the database that have externally added serializable attached objects
+      /// The output is type-grouped: one column per component type (the type hash is only written once per type)
+      /// \note Entities are written in iteration order, and restore_snapshot() returns the entities in that same order
+      static raw_data snapshot(database<DatabaseConf>& db, rle::status& st)
+      {
+        TRACY_SCOPED_ZONE;
+        snapshot_builder builder;
+        for_each_serializable_entity(db, [&](serializable& s)
+        {
+          for (size_t i = 0; i < s.get_concept_providers_count(); ++i)
+            builder.add(s.get_concept_provider(i), st);
+          ++builder.snapshot.entity_count;
+        });
+        return rle::serialize(builder.finalize(), &st);
+      }
+
+      /// \brief Create the entities serialized by snapshot()
+      /// \return the created entities, in the order they were serialized (empty on failure)
+      /// \note The entities are all created at once, then each one is deserialized from the snapshot data
+      ///       without any intermediate per-entity container
+      static std::vector<entity<DatabaseConf>> restore_snapshot(database<DatabaseConf>& db, const raw_data& data, rle::status& st)
+      {
+        TRACY_SCOPED_ZONE;
+        const internal::database_snapshot snapshot = rle::deserialize<internal::database_snapshot>(data, &st);
+        if (st == rle::status::failure)
+          return {};
+
+        std::vector<internal::column_view> columns;
+        if (!get_column_views(snapshot, columns))
+        {
+          st = rle::status::failure;
+          return {};
+        }
+        return restore_columns(db, snapshot.entity_count, columns, st);
+      }
+
+      /// \brief Same as snapshot(), but the trivially copyable attached objects (see concept_provider::is_pod_provider)
+      /// are written as raw, page-aligned columns, so that the output can be memory-mapped and loaded without decoding them.
+      /// The other attached objects are written in an embedded snapshot() stream.
+      /// \note The format is native (endianness, padding), so it should only be loaded by the same build
+      static std::vector<uint8_t> mapped_snapshot(database<DatabaseConf>& db, rle::status& st)
+      {
+        TRACY_SCOPED_ZONE;
+        struct pod_column_t
+        {
+          uint64_t type_hash;
+          uint64_t element_size;
+          std::vector<uint32_t> entity_indices;
+          std::vector<uint8_t> externally_added;
+          std::vector<uint8_t> data;
+        };
+
+        snapshot_builder builder;
+        std::vector<pod_column_t> pod_columns;
+        std::unordered_map<uint64_t, uint32_t> pod_column_indices;
+        for_each_serializable_entity(db, [&](serializable& s)
+        {
+          for (size_t i = 0; i < s.get_concept_providers_count(); ++i)
+          {
+            concept_logic& provider = s.get_concept_provider(i);
+            const std::span<const uint8_t> pod_data = provider._get_pod_data();
+            if (pod_data.empty())
+            {
+              builder.add(provider, st);
+              continue;
+            }
+
+            const uint64_t type_hash = provider._get_type_hash();
+            auto [it, inserted] = pod_column_indices.emplace(type_hash, (uint32_t)pod_columns.size());
+            if (inserted)
+              pod_columns.push_back({ type_hash, pod_data.size(), {}, {}, {} });
+
+            pod_column_t& column = pod_columns[it->second];
+            column.entity_indices.push_back(builder.snapshot.entity_count);
+            column.externally_added.push_back(provider._is_externally_added() ? 1 : 0);
+            column.data.insert(column.data.end(), pod_data.begin(), pod_data.end());
+          }
+          ++builder.snapshot.entity_count;
+        });
+
+        const raw_data rle_data = rle::serialize(builder.finalize(), &st);
+
+        // compute the layout:
+        constexpr auto align = [](uint64_t offset, uint64_t alignment) { return (offset + alignment - 1) / alignment * alignment; };
+        internal::mapped_snapshot_header header;
+        header.entity_count = builder.snapshot.entity_count;
+        header.column_count = (uint32_t)pod_columns.size();
+
+        std::vector<internal::mapped_snapshot_column> column_table;
+        column_table.reserve(pod_columns.size());
+        uint64_t offset = sizeof(header) + sizeof(internal::mapped_snapshot_column) * pod_columns.size();
+        for (const pod_column_t& column : pod_columns)
+        {
+          internal::mapped_snapshot_column& entry = column_table.emplace_back();
+          entry.type_hash = column.type_hash;
+          entry.element_size = column.element_size;
+          entry.element_count = column.entity_indices.size();
+          entry.entity_indices_offset = align(offset, alignof(uint32_t));
+          entry.externally_added_offset = entry.entity_indices_offset + entry.element_count * sizeof(uint32_t);
+          entry.data_offset = align(entry.externally_added_offset + entry.element_count, internal::mapped_snapshot_header::k_alignment);
+          offset = entry.data_offset + column.data.size();
+        }
+        header.rle_offset = align(offset, internal::mapped_snapshot_header::k_alignment);
+        header.rle_size = rle_data.size;
+
+        // write everything:
+        std::vector<uint8_t> ret(header.rle_offset + header.rle_size, 0);
+        std::memcpy(ret.data(), &header, sizeof(header));
+        std::memcpy(ret.data() + sizeof(header), column_table.data(), sizeof(internal::mapped_snapshot_column) * column_table.size());
+        for (uint32_t i = 0; i < pod_columns.size(); ++i)
+        {
+          const pod_column_t& column = pod_columns[i];
+          const internal::mapped_snapshot_column& entry = column_table[i];
+          std::memcpy(ret.data() + entry.entity_indices_offset, column.entity_indices.data(), column.entity_indices.size() * sizeof(uint32_t));
+          std::memcpy(ret.data() + entry.externally_added_offset, column.externally_added.data(), column.externally_added.size());
+          std::memcpy(ret.data() + entry.data_offset, column.data.data(), column.data.size());
+        }
+        std::memcpy(ret.data() + header.rle_offset, rle_data.data.get(), rle_data.size);
+        return ret;
+      }
+
+      /// \brief Create the entities serialized by mapped_snapshot()
+      /// The trivially copyable attached objects are copied directly from \e data (nothing is decoded)
+      /// \param data The snapshot. Should be memory-mapped (see mapped_file) for large databases. Must be at least 4-bytes aligned.
+      /// \return the created entities, in the order they were serialized (empty on failure)
+      static std::vector<entity<DatabaseConf>> load_mapped_snapshot(database<DatabaseConf>& db, std::span<const uint8_t> data, rle::status& st)
+      {
+        TRACY_SCOPED_ZONE;
+        const auto fail = [&st]()
+        {
+          st = rle::status::failure;
+          return std::vector<entity<DatabaseConf>>{};
+        };
+
+        internal::mapped_snapshot_header header;
+        if (data.size() < sizeof(header))
+          return fail();
+        std::memcpy(&header, data.data(), sizeof(header));
+        if (header.magic != internal::mapped_snapshot_header::k_magic || header.version != internal::mapped_snapshot_header::k_version)
+          return fail();
+        if ((uint64_t)header.column_count * sizeof(internal::mapped_snapshot_column) > data.size() - sizeof(header))
+          return fail();
+        if (header.rle_offset > data.size() || header.rle_size > data.size() - header.rle_offset)
+          return fail();
+        if ((uintptr_t)data.data() % alignof(uint32_t) != 0)
+          return fail();
+
+        // decode the attached objects that aren't trivially copyable:
+        raw_data rle_data = raw_data::allocate(header.rle_size);
+        std::memcpy(rle_data.data.get(), data.data() + header.rle_offset, header.rle_size);
+        const internal::database_snapshot snapshot = rle::deserialize<internal::database_snapshot>(rle_data, &st);
+        if (st == rle::status::failure || snapshot.entity_count != header.entity_count)
+          return fail();
+
+        std::vector<internal::column_view> columns;
+        if (!get_column_views(snapshot, columns))
+          return fail();
+
+        // add the raw columns:
+        columns.reserve(columns.size() + header.column_count);
+        for (uint32_t i = 0; i < header.column_count; ++i)
+        {
+          internal::mapped_snapshot_column entry;
+          std::memcpy(&entry, data.data() + sizeof(header) + i * sizeof(entry), sizeof(entry));
+
+          const auto in_bounds = [&data](uint64_t offset, uint64_t size) { return offset <= data.size() && size <= data.size() - offset; };
+          if (entry.element_size == 0 || entry.element_count > data.size() || entry.entity_indices_offset % alignof(uint32_t) != 0
+              || !in_bounds(entry.entity_indices_offset, entry.element_count * sizeof(uint32_t))
+              || !in_bounds(entry.externally_added_offset, entry.element_count)
+              || entry.element_size > data.size() || !in_bounds(entry.data_offset, entry.element_count * entry.element_size))
+          {
+            return fail();
+          }
+
+          const auto* get_pod_size = pod_size_map.find(entry.type_hash);
+          if (get_pod_size == nullptr || (*get_pod_size)() != entry.element_size)
+          {
+            check::debug::n_check(false, "load_mapped_snapshot: no trivially copyable attached object matches the column (type hash: {})", entry.type_hash);
+            return fail();
+          }
+
+          columns.push_back(
+          {
+            .type_hash = entry.type_hash,
+            .entity_indices = { reinterpret_cast<const uint32_t*>(data.data() + entry.entity_indices_offset), entry.element_count },
+            .externally_added = data.subspan(entry.externally_added_offset, entry.element_count),
+            .payloads = {},
+            .pod_data = data.subspan(entry.data_offset, entry.element_count * entry.element_size),
+            .element_size = entry.element_size,
+          });
+        }
+
+        return restore_columns(db, header.entity_count, columns, st);
+      }
+
+      /// \brief Load a file written from the output of mapped_snapshot()
+      static std::vector<entity<DatabaseConf>> load_mapped_snapshot(database<DatabaseConf>& db, const char* path, rle::status& st)
+      {
+        const mapped_file file(path);
+        if (!file.is_valid())
+        {
+          st = rle::status::failure;
+          return {};
+        }
+        return load_mapped_snapshot(db, file.get_data(), st);
+      }
+
+      /// \brief Whether \e type_hash is the type hash of a serializable attached object
+      static bool is_serializable_type(uint64_t type_hash)
+      {
+        return add_map.contains(type_hash);
+      }
+
+      /// \brief Externally add a serializable attached object (default constructed, no data is deserialized) from its type hash
+      /// (if the attached object is already present as a dependency, it is only flagged as externally added)
+      /// \note The entity lock must be held
+      /// \return false if no serializable attached object has that type hash
+      static bool add_by_type_hash(entity<DatabaseConf>& entity, uint64_t type_hash)
+      {
+        const auto* add_function = add_map.find(type_hash);
+        if (add_function == nullptr)
+          return false;
+        (*add_function)(entity);
+        return true;
+      }
+
+      /// \brief Remove an externally added serializable attached object from its type hash
+      /// (attached objects that are only present as a dependency are left untouched)
+      /// \note The entity lock must be held
+      /// \return false if no serializable attached object has that type hash
+      static bool remove_by_type_hash(entity<DatabaseConf>& entity, uint64_t type_hash)
+      {
+        if (!is_serializable_type(type_hash))
+          return false;
+        serializable* concept_ptr = entity.template get<serializable>();
+        if (concept_ptr == nullptr)
+          return true;
+        for (size_t i = 0; i < concept_ptr->get_concept_providers_count(); ++i)
+        {
+          concept_logic& provider = concept_ptr->get_concept_provider(i);
+          if (provider._get_type_hash() == type_hash)
+          {
+            if (provider._is_externally_added())
+              provider._do_remove(entity);
+            break;
+          }
+        }
+        return true;
       }
 
     private:
-      void deserialize(entity<DatabaseConf>& entity, internal::serialized_entity&& serialized_entity)
+      static void get_delta_components(const internal::serialized_entity_delta& delta, std::vector<internal::persistent_component>& components)
+      {
+        components.reserve(delta.changed_components.size() + delta.unchanged_components.size());
+        const auto is_externally_added = [&delta](uint64_t type_hash)
+        {
+          return std::find(delta.externally_added_components.begin(), delta.externally_added_components.end(), type_hash) != delta.externally_added_components.end();
+        };
+        for (const auto& it : delta.changed_components)
+          components.push_back({it.first, &it.second, is_externally_added(it.first)});
+        for (uint64_t it : delta.unchanged_components)
+          components.push_back({ .type_hash = it, .data = nullptr, .externally_added = is_externally_added(it), .unchanged = true });
+        std::sort(components.begin(), components.end(), [](const auto& a, const auto& b) { return a.type_hash < b.type_hash; });
+      }
+
+      /// \brief Gather serializable attached objects into type-grouped columns
+      struct snapshot_builder
+      {
+        internal::database_snapshot snapshot;
+        std::unordered_map<uint64_t, uint32_t> column_indices;
+
+        /// \brief Add the attached object to the current entity (snapshot.entity_count)
+        void add(concept_logic& provider, rle::status& st)
+        {
+          const uint64_t type_hash = provider._get_type_hash();
+          auto [it, inserted] = column_indices.emplace(type_hash, (uint32_t)snapshot.columns.size());
+          if (inserted)
+          {
+            snapshot.type_hashes.push_back(type_hash);
+            snapshot.columns.emplace_back();
+          }
+
+          internal::snapshot_column& column = snapshot.columns[it->second];
+          column.entity_indices.push_back(snapshot.entity_count);
+          column.externally_added.push_back(provider._is_externally_added() ? 1 : 0);
+          column.payloads.push_back(provider._do_serialize(st));
+        }
+
+        /// \brief Return the snapshot, with the type-hash table (and the columns with it) sorted
+        internal::database_snapshot finalize()
+        {
+          std::vector<uint32_t> order(snapshot.columns.size());
+          for (uint32_t i = 0; i < order.size(); ++i)
+            order[i] = i;
+          std::sort(order.begin(), order.end(), [this](uint32_t a, uint32_t b) { return snapshot.type_hashes[a] < snapshot.type_hashes[b]; });
+
+          internal::database_snapshot sorted;
+          sorted.entity_count = snapshot.entity_count;
+          sorted.type_hashes.reserve(order.size());
+          sorted.columns.reserve(order.size());
+          for (uint32_t i : order)
+          {
+            sorted.type_hashes.push_back(snapshot.type_hashes[i]);
+            sorted.columns.push_back(std::move(snapshot.columns[i]));
+          }
+          return sorted;
+        }
+      };
+
+      /// \brief Call func(serializable&) for every entity that can be recreated from its serialized data
+      /// (like serialize(), entities without externally added serializable attached objects are skipped)
+      template<typename Function>
+      static void for_each_serializable_entity(database<DatabaseConf>& db, Function&& func)
       {
-        // generate the list of present attached objects
-        std::map<uint64_t, concept_logic&> present_attached_objects;
-        this->for_each_concept_provider([&present_attached_objects](concept_logic & prov)
+        db.for_each([&func](serializable& s)
         {
-          present_attached_objects.emplace(prov._get_type_hash(), prov);
+          for (size_t i = 0; i < s.get_concept_providers_count(); ++i)
+          {
+            if (s.get_concept_provider(i)._is_externally_added())
+            {
+              func(s);
+              return;
+            }
+          }
         });
+      }
+
+      static bool get_column_views(const internal::database_snapshot& snapshot, std::vector<internal::column_view>& columns)
+      {
+        if (snapshot.type_hashes.size() != snapshot.columns.size())
+          return false;
 
-        persistent_data = &serialized_entity;
-        for (uint64_t it : serialized_entity.externally_added_components)
+        columns.reserve(snapshot.columns.size());
+        for (uint32_t i = 0; i < snapshot.columns.size(); ++i)
         {
-          auto pao = present_attached_objects.find(it);
-          if (pao != present_attached_objects.end())
+          const internal::snapshot_column& column = snapshot.columns[i];
+          if (column.entity_indices.size() != column.payloads.size() || column.externally_added.size() != column.payloads.size())
+            return false;
+          columns.push_back({ .type_hash = snapshot.type_hashes[i], .entity_indices = column.entity_indices, .externally_added = column.externally_added, .payloads = column.payloads });
+        }
+        return true;
+      }
+
+      /// \brief Create \e entity_count entities and deserialize them from the columns
+      /// The per-entity component lists are built in a single allocation (counting sort on the entity index)
+      static std::vector<entity<DatabaseConf>> restore_columns(database<DatabaseConf>& db, uint32_t entity_count, std::vector<internal::column_view>& columns, rle::status& st)
+      {
+        // sorting the columns by type hash makes the list of every entity sorted too
+        std::sort(columns.begin(), columns.end(), [](const internal::column_view& a, const internal::column_view& b) { return a.type_hash < b.type_hash; });
+
+        std::vector<uint32_t> offsets(entity_count + 1, 0);
+        for (uint32_t i = 0; i < columns.size(); ++i)
+        {
+          if (i > 0 && columns[i - 1].type_hash == columns[i].type_hash)
+          {
+            st = rle::status::failure;
+            return {};
+          }
+          if (!require_map.contains(columns[i].type_hash))
+          {
+            check::debug::n_check(false, "restore_snapshot: unable to find the corresponding attached object (type hash: {})", columns[i].type_hash);
+            st = rle::status::failure;
+            return {};
+          }
+          for (uint32_t entity_index : columns[i].entity_indices)
+          {
+            if (entity_index >= entity_count)
+            {
+              st = rle::status::failure;
+              return {};
+            }
+            ++offsets[entity_index + 1];
+          }
+        }
+        for (uint32_t i = 1; i < offsets.size(); ++i)
+          offsets[i] += offsets[i - 1];
+
+        std::vector<internal::persistent_component> components(offsets.back());
+        {
+          std::vector<uint32_t> cursors(offsets.begin(), offsets.end() - 1);
+          for (const internal::column_view& column : columns)
           {
-            // refresh the attached object
-            pao->second._do_refresh_serializable_data();
+            for (uint32_t j = 0; j < column.entity_indices.size(); ++j)
+            {
+              internal::persistent_component& component = components[cursors[column.entity_indices[j]]++];
+              component.type_hash = column.type_hash;
+              component.externally_added = column.externally_added[j] != 0;
+              if (column.element_size != 0)
+              {
+                component.data = nullptr;
+                component.pod_data = column.pod_data.subspan(j * column.element_size, column.element_size);
+              }
+              else
+              {
+                component.data = &column.payloads[j];
+              }
+            }
+          }
+        }
+
+        std::vector<entity<DatabaseConf>> entities = db.create_entities(entity_count);
+        for (uint32_t i = 0; i < entities.size(); ++i)
+        {
+          std::lock_guard _lg(spinlock_exclusive_adapter::adapt(entities[i].get_lock()));
+          const internal::persistent_data persistent_data { std::span<const internal::persistent_component>(components).subspan(offsets[i], offsets[i + 1] - offsets[i]) };
+          deserialize_entity(entities[i], persistent_data);
+        }
+        return entities;
+      }
+
+      /// \brief Deserialize the attached objects of a new entity (that has no serializable attached objects)
+      /// Unlike deserialize(db, data), this does not go through a deserialization_marker:
+      /// the persistent data is handed to the concept when the first attached object creates it.
+      /// \note The persistent data is per-thread, so multiple entities can be deserialized in parallel
+      static void deserialize_entity(entity<DatabaseConf>& entity, const internal::persistent_data& data)
+      {
+        check::debug::n_assert(new_entity_persistent_data == nullptr, "deserialize_entity: recursive deserialization of new entities is not supported");
+        new_entity_persistent_data = &data;
+        for (const internal::persistent_component& it : data.components)
+        {
+          if (!it.externally_added)
+            continue;
+
+          if (const auto* require_function = require_map.find(it.type_hash); require_function != nullptr)
+            (*require_function)(entity);
+          else
+            check::debug::n_assert(false, "Unable to find the corresponding attached object");
+        }
+        new_entity_persistent_data = nullptr;
+
+        if (serializable* concept_ptr = entity.template get<serializable>())
+          concept_ptr->persistent_data = nullptr;
+      }
+
+      /// \brief Fill \e components with views of the serialized data (either format)
+      /// \param v1_storage Where the v1 format is decoded. Must outlive components.
+      static bool get_components(const raw_data& data, internal::serialized_entity& v1_storage, std::vector<internal::persistent_component>& components, rle::status& st)
+      {
+        if (!internal::is_flat_serialized_entity(data))
+        {
+          v1_storage = rle::deserialize<internal::serialized_entity>(data, &st);
+          if (st == rle::status::failure)
+            return false;
+          get_components(v1_storage, components);
+          return true;
+        }
+
+        const uint8_t* const ptr = reinterpret_cast<const uint8_t*>(data.data.get());
+        internal::flat_serialized_entity_header header;
+        std::memcpy(&header, ptr, sizeof(header));
+        const size_t table_size = (size_t)header.component_count * sizeof(internal::flat_serialized_entity_entry);
+        if (table_size > data.size - sizeof(header))
+        {
+          st = rle::status::failure;
+          return false;
+        }
+
+        const size_t payload_offset = sizeof(header) + table_size;
+        const size_t payload_size = data.size - payload_offset;
+        components.reserve(header.component_count);
+        for (uint32_t i = 0; i < header.component_count; ++i)
+        {
+          internal::flat_serialized_entity_entry entry;
+          std::memcpy(&entry, ptr + sizeof(header) + i * sizeof(entry), sizeof(entry));
+          if (entry.offset > payload_size || entry.size > payload_size - entry.offset
+              || (i > 0 && components.back().type_hash >= entry.type_hash))
+          {
+            st = rle::status::failure;
+            return false;
+          }
+          components.push_back({ .type_hash = entry.type_hash, .data = nullptr, .externally_added = entry.externally_added != 0,
+                                 .rle_data = { ptr + payload_offset + entry.offset, entry.size } });
+        }
+        return true;
+      }
+
+      static void get_components(const internal::serialized_entity& serialized_entity, std::vector<internal::persistent_component>& components)
+      {
+        // serialized_components is a map, so the components are already sorted by type hash
+        components.reserve(serialized_entity.serialized_components.size());
+        for (const auto& it : serialized_entity.serialized_components)
+        {
+          const bool externally_added = std::find(serialized_entity.externally_added_components.begin(),
+                                                  serialized_entity.externally_added_components.end(),
+                                                  it.first) != serialized_entity.externally_added_components.end();
+          components.push_back({it.first, &it.second, externally_added});
+        }
+      }
+
+      /// \brief Call func(index) for every index in [0, count[, split across multiple tasks
+      template<typename Function>
+      static threading::task_wrapper dispatch_batch(threading::task_manager& tm, threading::group_t group_id, size_t count, Function&& func)
+      {
+        const uint32_t max_task_count = std::max(1u, std::thread::hardware_concurrency());
+        const uint32_t task_count = (uint32_t)std::clamp<size_t>(count / k_min_entity_count_per_task, 1, max_task_count);
+        const size_t entity_per_task = (count + task_count - 1) / task_count;
+
+        auto final_task = tm.get_task(group_id, []() {});
+        for (uint32_t i = 0; i < task_count; ++i)
+        {
+          const size_t begin = std::min(i * entity_per_task, count);
+          const size_t end = std::min(begin + entity_per_task, count);
+          auto task = tm.get_task(group_id, [func, begin, end]()
+          {
+            TRACY_SCOPED_ZONE;
+            for (size_t j = begin; j < end; ++j)
+              func(j);
+          });
+          final_task->add_dependency_to(*task);
+        }
+        return final_task;
+      }
+
+      void deserialize(entity<DatabaseConf>& entity, const internal::persistent_data& data)
+      {
+        // only the attached objects present before the deserialization are refreshed / removed
+        // (providers are appended, so they are the first present_count ones)
+        const size_t present_count = this->get_concept_providers_count();
+        const auto find_present = [this, present_count](uint64_t type_hash) -> concept_logic*
+        {
+          for (size_t i = 0; i < present_count; ++i)
+          {
+            if (this->get_concept_provider(i)._get_type_hash() == type_hash)
+              return &this->get_concept_provider(i);
+          }
+          return nullptr;
+        };
+
+        persistent_data = &data;
+        for (const internal::persistent_component& it : data.components)
+        {
+          if (!it.externally_added)
+            continue;
+
+          if (concept_logic* present = find_present(it.type_hash); present != nullptr)
+          {
+            // refresh the attached object (if it has changed)
+            if (it.has_data())
+              present->_do_refresh_serializable_data();
           }
           else
           {
             // create the attached object
-            auto fncit = require_map.find(it);
-            if (fncit != require_map.end())
+            if (const auto* require_function = require_map.find(it.type_hash); require_function != nullptr)
             {
               // call the require function pointer
-              fncit->second(*this, entity);
+              (*require_function)(entity);
             }
             else
             {
@@ -330,22 +1385,33 @@ namespace neam::enfield::concepts
         }
         persistent_data = nullptr;
 
-        // remove extra components
-        for (auto& it : present_attached_objects)
+        // remove extra components (removing them changes the provider list, so gather them first)
+        std::vector<concept_logic*> to_remove;
+        for (size_t i = 0; i < present_count; ++i)
         {
-          if (!serialized_entity.serialized_components.count(it.first))
-          {
-            it.second._do_remove(entity);
-          }
+          if (data.find(this->get_concept_provider(i)._get_type_hash()) == nullptr)
+            to_remove.push_back(&this->get_concept_provider(i));
         }
+        for (concept_logic* it : to_remove)
+          it->_do_remove(entity);
       }
 
     private:
-      static inline std::map<type_t, void (*)(serializable&, entity<DatabaseConf> &)> require_map;
+      static inline internal::type_hash_table<void (*)(entity<DatabaseConf> &)> require_map;
       // force instantiation of the static member: (and avoid a warning)
       static_assert(&require_map == &require_map);
+      static inline internal::type_hash_table<size_t (*)()> pod_size_map;
+      static inline internal::type_hash_table<void (*)(entity<DatabaseConf> &)> add_map;
+      static_assert(&add_map == &add_map);
 
-      const internal::serialized_entity* persistent_data = nullptr;
+      // see deserialize_entity()
+      static inline thread_local const internal::persistent_data* new_entity_persistent_data = nullptr;
+
+      static constexpr size_t k_min_entity_count_per_task = 64;
+      static_assert(&pod_size_map == &pod_size_map);
+
+      const internal::persistent_data* persistent_data = nullptr;
+      size_t delta_baseline_provider_count = ~size_t(0);
 
       friend ecs_concept;
       friend class deserialization_marker;
@@ -355,7 +1421,9 @@ namespace neam::enfield::concepts
   template<typename ConceptProvider>
   int serializable<DatabaseConf>::concept_provider<ConceptProvider>::_dummy_ = []()
   {
-    serializable::require_map.emplace(ct::type_hash<ConceptProvider>, &require_concept_provider);
+    serializable::require_map.insert(ct::type_hash<ConceptProvider>, &require_concept_provider);
+    serializable::pod_size_map.insert(ct::type_hash<ConceptProvider>, &get_pod_size);
+    serializable::add_map.insert(ct::type_hash<ConceptProvider>, &add_concept_provider);
     return 0;
   }();
 }
@@ -369,3 +1437,32 @@ N_METADATA_STRUCT(neam::enfield::concepts::internal::serialized_entity)
   >;
 };
 
+N_METADATA_STRUCT(neam::enfield::concepts::internal::serialized_entity_delta)
+{
+  using member_list = neam::ct::type_list
+  <
+    N_MEMBER_DEF(externally_added_components),
+    N_MEMBER_DEF(unchanged_components),
+    N_MEMBER_DEF(changed_components)
+  >;
+};
+
+N_METADATA_STRUCT(neam::enfield::concepts::internal::snapshot_column)
+{
+  using member_list = neam::ct::type_list
+  <
+    N_MEMBER_DEF(entity_indices),
+    N_MEMBER_DEF(externally_added),
+    N_MEMBER_DEF(payloads)
+  >;
+};
+
+N_METADATA_STRUCT(neam::enfield::concepts::internal::database_snapshot)
+{
+  using member_list = neam::ct::type_list
+  <
+    N_MEMBER_DEF(entity_count),
+    N_MEMBER_DEF(type_hashes),
+    N_MEMBER_DEF(columns)
+  >;
+};
@@ -31,9 +31,17 @@
 
 
 #include <unordered_set>
+#include <unordered_map>
 #include <algorithm>
+#include <atomic>
 #include <array>
 #include <deque>
+#include <memory>
+#include <optional>
+#include <thread>
+#include <tuple>
+#include <utility>
+#include <bit>
 #include <vector>
 #include <type_traits>
 
@@ -41,6 +49,8 @@
 #include "database_conf.hpp"
 #include "type_registry.hpp"
 #include "attached_object_utility.hpp"
+#include "append_segment.hpp"
+#include "database_observer.hpp"
 #include "query.hpp"
 
 #include <ntools/memory_pool.hpp>
@@ -84,9 +94,23 @@ namespace neam
           // deletion is the trigger point for re-arranging the array
           std::atomic<uint32_t> deletion_count;
 
+          // number of entries in db that are neither tombstones nor being destructed
+          std::atomic<uint32_t> live_count;
+
           // operation on entries in the db are shared operations, operations that operate on the DB object itself are exclusives
           mutable shared_spinlock lock;
           std::deque<cr::raw_ptr<base_t>> db;
+
+          // attached objects created with force_immediate_changes: inserted without exclusive lock,
+          // moved to db on apply_component_db_changes. (index-wise, it is after db)
+          append_segment<base_t> immediate_db;
+
+          // dense list of the entries whose owner is awake (only maintained when has_active_set is true)
+          // removed entries are left as tombstones until the next apply_component_db_changes
+          // (tombstones are written under the shared lock, so entries must be accessed with std::atomic_ref)
+          std::atomic<bool> has_active_set = false;
+          std::atomic<uint32_t> active_deletion_count;
+          std::vector<base_t*> active_db;
         };
 
         database(const database&) = delete;
@@ -121,6 +145,7 @@ namespace neam
           new (data) entity_data_t(*this); // construct
 
           data->weak_ref_indirection = entity_t::weak_ref_indirection_t::create(data);
+          data->mask_version = next_mask_version();
 
           entity_t ret(*data);
 #if ENFIELD_ENABLE_DEBUG_CHECKS
@@ -135,9 +160,71 @@ namespace neam
             entity_list.push_back(data);
           }
 
+          if (observer != nullptr)
+          {
+            std::lock_guard _lg(spinlock_exclusive_adapter::adapt(data->lock));
+            observer->on_entity_created(*data);
+          }
+
           return ret;
         }
 
+        /// \brief Create \e count entities at once
+        /// \note Faster than calling create_entity() in a loop, as the entity list is only locked once
+        std::vector<entity_t> create_entities(size_t count)
+        {
+          TRACY_SCOPED_ZONE;
+          std::vector<entity_t> ret;
+          ret.reserve(count);
+          for (size_t i = 0; i < count; ++i)
+          {
+            entity_data_t* data = entity_data_pool.allocate();
+            new (data) entity_data_t(*this); // construct
+
+            data->weak_ref_indirection = entity_t::weak_ref_indirection_t::create(data);
+            data->mask_version = next_mask_version();
+#if ENFIELD_ENABLE_DEBUG_CHECKS
+            data->assert_valid();
+#endif
+            ret.emplace_back(*data);
+          }
+
+          if constexpr (DatabaseConf::use_entity_db)
+          {
+            // for systems
+            std::lock_guard _lg(spinlock_exclusive_adapter::adapt(entity_list_lock));
+            for (entity_t& it : ret)
+            {
+              entity_data_t& data = *it.data;
+              data.index = entity_list.size();
+              entity_list.push_back(&data);
+            }
+          }
+
+          if (observer != nullptr)
+          {
+            for (entity_t& it : ret)
+            {
+              std::lock_guard _lg(spinlock_exclusive_adapter::adapt(it.data->lock));
+              observer->on_entity_created(*it.data);
+            }
+          }
+
+          return ret;
+        }
+
+        /// \brief Set the object that will be notified of the structural changes of the database (nullptr to remove it)
+        /// \warning Must not be called while the database is being modified
+        void set_observer(database_observer<DatabaseConf>* _observer)
+        {
+          observer = _observer;
+        }
+
+        database_observer<DatabaseConf>* get_observer() const
+        {
+          return observer;
+        }
+
         size_t get_entity_count() const
         {
           static_assert(DatabaseConf::use_entity_db, "cannot call get_entity_count when entity-db is disabled");
@@ -159,8 +246,228 @@ namespace neam
           else
           {
             check::debug::n_assert(id < DatabaseConf::max_attached_objects_types, "get_attached_object_count: type-id is too big (id: {}, max: {})", id, DatabaseConf::max_attached_objects_types);
-            return attached_object_db[id].db.size();
+            return attached_object_db[id].db.size() + attached_object_db[id].immediate_db.size();
+          }
+        }
+
+        /// \brief Return the number of live attached objects of a given type
+        /// Unlike get_attached_object_count(), this does not include the tombstones left by removed attached objects
+        /// \note This is a maintained counter, so it's O(1).
+        /// \note Might miss attached objects added before apply_component_db_changes
+        template<typename AttachedObject>
+        size_t get_live_attached_object_count() const
+        {
+          return get_live_attached_object_count(id_t<AttachedObject>::id());
+        }
+
+        /// \brief Start maintaining the active set of an attached object type (the entries whose owner isn't sleeping)
+        /// \note Systems with use_active_set enable the active set of the attached object they iterate over
+        /// \note Enabling is done once, and is O(n). It should not be called while systems or for-each are running.
+        template<typename AttachedObject>
+        void enable_active_set()
+        {
+          enable_active_set(id_t<AttachedObject>::id());
+        }
+
+        void enable_active_set(type_t id)
+        {
+          if constexpr (DatabaseConf::use_attached_object_db)
+          {
+            check::debug::n_assert(id < DatabaseConf::max_attached_objects_types, "enable_active_set: type-id is too big (id: {}, max: {})", id, DatabaseConf::max_attached_objects_types);
+            attached_object_db_t& aodb = attached_object_db[id];
+            if (aodb.has_active_set.load(std::memory_order_acquire))
+              return;
+
+            TRACY_SCOPED_ZONE;
+            std::lock_guard _lg(spinlock_exclusive_adapter::adapt(aodb.lock));
+            // another thread may have enabled it while we were waiting for the lock
+            if (aodb.has_active_set.load(std::memory_order_relaxed))
+              return;
+            for (base_t* it : aodb.db)
+            {
+              if (it != nullptr && !it->authorized_destruction && !it->owner.sleeping.load(std::memory_order_relaxed))
+                add_to_active_set(*it);
+            }
+            aodb.has_active_set.store(true, std::memory_order_release);
+          }
+        }
+
+        /// \brief Return the number of entries in the active set of an attached object type (including tombstones)
+        size_t get_active_attached_object_count(type_t id) const
+        {
+          if constexpr(!DatabaseConf::use_attached_object_db)
+          {
+            return 0;
+          }
+          else
+          {
+            check::debug::n_assert(id < DatabaseConf::max_attached_objects_types, "get_active_attached_object_count: type-id is too big (id: {}, max: {})", id, DatabaseConf::max_attached_objects_types);
+            return attached_object_db[id].active_db.size();
+          }
+        }
+
+        size_t get_live_attached_object_count(type_t id) const
+        {
+          if constexpr(!DatabaseConf::use_attached_object_db)
+          {
+            return 0;
+          }
+          else
+          {
+            check::debug::n_assert(id < DatabaseConf::max_attached_objects_types, "get_live_attached_object_count: type-id is too big (id: {}, max: {})", id, DatabaseConf::max_attached_objects_types);
+            return attached_object_db[id].live_count.load(std::memory_order_acquire);
+          }
+        }
+
+        /// \brief Return the number of (enabled) entities that have all the attached objects
+        /// \note When a single attached object is requested and no entity is disabled, this is O(1)
+        /// \note Might miss attached objects added before apply_component_db_changes
+        template<typename... AttachedObjects>
+        size_t count() const
+        {
+          TRACY_SCOPED_ZONE;
+          static_assert(sizeof...(AttachedObjects) > 0, "count: at least one attached object type is required");
+
+          if constexpr (DatabaseConf::use_attached_object_db && sizeof...(AttachedObjects) == 1)
+          {
+            attached_object_utility_t<AttachedObjects...>::check();
+            attached_object_utility_t<AttachedObjects...>::check_materialized(*this);
+            if (disabled_entity_count.load(std::memory_order_acquire) == 0)
+              return get_live_attached_object_count(id_t<AttachedObjects>::id()...);
           }
+
+          size_t ret = 0;
+          for_each_list<ct::type_list<AttachedObjects...>>([&ret](const AttachedObjects& ...) { ++ret; });
+          return ret;
+        }
+
+        /// \brief Fold all the entities that have all the attached objects into a single value
+        /// \param op a function or function-like object with the signature Type(Type&& accumulator, AttachedObjects& ...)
+        /// \note Might miss attached objects added before apply_component_db_changes
+        template<typename... AttachedObjects, typename Type, typename Function>
+        Type reduce(Type init, Function&& op)
+        {
+          TRACY_SCOPED_ZONE;
+          for_each_list<ct::type_list<AttachedObjects...>>([&init, &op](AttachedObjects& ... objs)
+          {
+            init = op(std::move(init), objs...);
+          });
+          return init;
+        }
+
+        template<typename... AttachedObjects, typename Type, typename Function>
+        Type reduce(Type init, Function&& op) const
+        {
+          TRACY_SCOPED_ZONE;
+          for_each_list<ct::type_list<AttachedObjects...>>([&init, &op](const AttachedObjects& ... objs)
+          {
+            init = op(std::move(init), objs...);
+          });
+          return init;
+        }
+
+        /// \brief Parallel version of reduce. The entries are split across multiple tasks whose results are then merged.
+        /// \param init The initial value of every partial reduction. Must be neutral for \e merge.
+        /// \param merge a function or function-like object with the signature Type(Type&& a, Type&& b)
+        /// \param result Where the result will be written. Must stay valid until the returned task has completed.
+        /// \return The final task (\e result is only written when that task runs)
+        /// \warning The database must not be optimized while the tasks are in flight
+        template<typename... AttachedObjects, typename Type, typename Function, typename MergeFunction>
+        threading::task_wrapper reduce(threading::task_manager& tm, threading::group_t group_id,
+                                       Type init, Function&& op, MergeFunction&& merge, Type& result)
+        {
+          static_assert(DatabaseConf::use_attached_object_db, "Cannot perform parallel reductions when use_attached_object_db is false");
+          using utility = attached_object_utility_t<AttachedObjects...>;
+          utility::check();
+          utility::check_materialized(*this);
+
+          type_t attached_object_id;
+          size_t entry_count;
+          {
+            typename utility::shared_locker _sl{*this};
+            std::lock_guard _l(_sl);
+            attached_object_id = utility::get_min_entry_count(*this);
+            entry_count = get_attached_object_count(attached_object_id);
+          }
+
+          const uint32_t max_task_count = std::max(1u, std::thread::hardware_concurrency());
+          const uint32_t task_count = (uint32_t)std::clamp<size_t>(entry_count / k_min_entry_count_per_task, 1, max_task_count);
+          const size_t entry_per_task = (entry_count + task_count - 1) / task_count;
+
+          auto partials = std::make_shared<std::vector<Type>>(task_count, init);
+          auto final_task = tm.get_task(group_id, [partials, merge, &result]()
+          {
+            TRACY_SCOPED_ZONE;
+            Type acc = std::move((*partials)[0]);
+            for (uint32_t i = 1; i < partials->size(); ++i)
+              acc = merge(std::move(acc), std::move((*partials)[i]));
+            result = std::move(acc);
+          });
+
+          for (uint32_t i = 0; i < task_count; ++i)
+          {
+            const size_t begin = std::min(i * entry_per_task, entry_count);
+            const size_t end = std::min(begin + entry_per_task, entry_count);
+            auto task = tm.get_task(group_id, [this, partials, op, i, begin, end, attached_object_id]()
+            {
+              TRACY_SCOPED_ZONE;
+              typename utility::shared_locker _sl{*this};
+              std::lock_guard _l(_sl);
+
+              const inline_mask<DatabaseConf> mask = utility::make_mask();
+              Type& acc = (*partials)[i];
+              for (size_t j = begin; j < end; ++j)
+              {
+                entity_data_t* data = get_attached_object_owner(j, attached_object_id);
+                if (data != nullptr && data->enabled && mask.match(data->mask))
+                {
+                  std::lock_guard _lg(spinlock_shared_adapter::adapt(data->lock));
+                  utility::call([&acc, &op](AttachedObjects& ... objs)
+                  {
+                    acc = op(std::move(acc), objs...);
+                  }, *this, *data);
+                }
+              }
+            });
+            final_task->add_dependency_to(*task);
+          }
+
+          return final_task;
+        }
+
+        /// \brief Parallel version of count
+        /// \see reduce
+        template<typename... AttachedObjects>
+        threading::task_wrapper count(threading::task_manager& tm, threading::group_t group_id, size_t& result)
+        {
+          if (DatabaseConf::use_attached_object_db && sizeof...(AttachedObjects) == 1 && disabled_entity_count.load(std::memory_order_acquire) == 0)
+          {
+            // maintained counter: there's nothing to dispatch
+            return tm.get_task(group_id, [this, &result]() { result = this->template count<AttachedObjects...>(); });
+          }
+          else
+          {
+            return reduce<AttachedObjects...>(tm, group_id, size_t(0),
+                                              [](size_t acc, AttachedObjects& ...) { return acc + 1; },
+                                              [](size_t a, size_t b) { return a + b; },
+                                              result);
+          }
+        }
+
+        /// \brief Return the attached objects of the entity with the smallest key (or nullptrs if no entity matched)
+        /// \param key a function or function-like object with the signature Key(const AttachedObjects& ...)
+        template<typename... AttachedObjects, typename KeyFunction>
+        std::tuple<AttachedObjects*...> min_by(KeyFunction&& key)
+        {
+          return select_by<AttachedObjects...>(key, [](const auto& a, const auto& b) { return a < b; });
+        }
+
+        /// \brief Return the attached objects of the entity with the largest key (or nullptrs if no entity matched)
+        /// \param key a function or function-like object with the signature Key(const AttachedObjects& ...)
+        template<typename... AttachedObjects, typename KeyFunction>
+        std::tuple<AttachedObjects*...> max_by(KeyFunction&& key)
+        {
+          return select_by<AttachedObjects...>(key, [](const auto& a, const auto& b) { return b < a; });
         }
 
         /// \brief Iterate over each attached object of a given type
@@ -187,13 +494,34 @@ namespace neam
           for_each_list<list>(func);
         }
 
+        /// \brief Iterate over each attached object of a given type
+        /// \param filter entity_filter::include_disabled to also iterate over disabled entities
+        template<typename Function>
+        void for_each(entity_filter filter, Function&& func)
+        {
+          TRACY_SCOPED_ZONE;
+          using list = ct::list::for_each<typename ct::function_traits<Function>::arg_list, rm_rcv>;
+
+          for_each_list<list>(func, filter);
+        }
+
+        template<typename Function>
+        void for_each(entity_filter filter, Function&& func) const
+        {
+          TRACY_SCOPED_ZONE;
+          using list = ct::list::for_each<typename ct::function_traits<Function>::arg_list, rm_rcv>;
+
+          for_each_list<list>(func, filter);
+        }
+
         /// \brief Perform a query in the DB.
         /// \see for_each
         /// \note Calling apply_component_db_changes invalidates existing queries
         /// \note Calling apply_component_db_changes is necessary at least once a frame
         /// \note Might miss attached objects added before apply_component_db_changes
+        /// \param filter entity_filter::include_disabled to also return the attached objects of disabled entities
         template<typename AttachedObject>
-        query_t<DatabaseConf, AttachedObject> query() const
+        query_t<DatabaseConf, AttachedObject> query(entity_filter filter = entity_filter::enabled_only) const
         {
           if constexpr(!DatabaseConf::use_attached_object_db)
           {
@@ -205,16 +533,18 @@ namespace neam
 
           static_assert_check_attached_object<DatabaseConf, AttachedObject>();
           static_assert_can<DatabaseConf, AttachedObject::ao_class_id, attached_object_access::db_queryable>();
+          check::debug::n_assert(is_materialized(id_t<AttachedObject>::id()), "query: lazy attached object type has not been materialized (see database::materialize)");
 
           const type_t attached_object_id = type_id<AttachedObject, typename DatabaseConf::attached_object_type>::id;
           if (attached_object_id > DatabaseConf::max_attached_objects_types)
             return {};
 
           std::deque<AttachedObject*> ret;
-          for (uint32_t i = 0; i < attached_object_db[attached_object_id].db.size(); ++i)
+          const size_t count = get_attached_object_count(attached_object_id);
+          for (size_t i = 0; i < count; ++i)
           {
-            base_t* ptr = attached_object_db[attached_object_id].db[i];
-            if (ptr->authorized_destruction == false)
+            base_t* ptr = get_attached_object_entry(attached_object_db[attached_object_id], i);
+            if (ptr != nullptr && ptr->authorized_destruction == false && (ptr->owner.enabled || filter == entity_filter::include_disabled))
               ret.push_back(static_cast<AttachedObject*>(ptr));
           }
 
@@ -375,7 +705,110 @@ namespace neam
           return final_task;
         }
 
-        /// \brief Apply attached-object destruction, maintain the query caches
+        /// \brief Return an object shared by the whole database (created on first use)
+        /// Used by attached objects that need database-wide state (like the provider groups of concepts)
+        /// \tparam Type Must be default constructible. Is destructed with the database.
+        /// \note Thread safe, but the returned object has to handle its own synchronization
+        template<typename Type>
+        Type& get_shared_object()
+        {
+          // fast path: a lock-free lookup in the slot of the type (the slot is set once the object is created)
+          const uint32_t slot = get_shared_object_slot<Type>();
+          if (slot < k_shared_object_slot_count)
+          {
+            if (void* object = shared_object_slots[slot].load(std::memory_order_acquire); object != nullptr)
+              return *static_cast<Type*>(object);
+          }
+
+          std::lock_guard _lg(spinlock_exclusive_adapter::adapt(shared_objects_lock));
+          std::shared_ptr<void>& ptr = shared_objects[&shared_object_key<Type>];
+          if (!ptr)
+            ptr = std::make_shared<Type>();
+          if (slot < k_shared_object_slot_count)
+            shared_object_slots[slot].store(ptr.get(), std::memory_order_release);
+          return *static_cast<Type*>(ptr.get());
+        }
+
+        /// \brief Materialize lazy attached object types (see ecs_concept::lazy_materialization)
+        /// Types are materialized when a system using them is added, or by calling this function.
+        /// Once requested, the type stays materialized (the attached objects are then created right away).
+        /// Concurrent callers wait for the materialization to be complete.
+        /// \note For-each, count, reduce and queries don't materialize types (they assert instead), as materializing
+        ///       takes the lock of every providing entity, and those are routinely called with an entity lock held
+        /// \warning Materializing a type creates its attached objects on all the entities that provide them,
+        ///          so it must not run concurrently with changes to those entities
+        template<typename... AttachedObjects>
+        void materialize()
+        {
+          (materialize(id_t<AttachedObjects>::id()), ...);
+        }
+
+        void materialize(type_t id)
+        {
+          check::debug::n_assert(id < DatabaseConf::max_attached_objects_types, "materialize: type-id is too big (id: {}, max: {})", id, DatabaseConf::max_attached_objects_types);
+          lazy_type_t& lazy = lazy_types[id];
+          if (lazy.is_requested.load(std::memory_order_acquire))
+            return;
+
+          // held until the materialization is complete, so other callers wait for it
+          // (lazy.lock is not held while the materializer runs, as providers take it while holding their own locks)
+          std::lock_guard _mlg(spinlock_exclusive_adapter::adapt(lazy.materialization_lock));
+          if (lazy.is_requested.load(std::memory_order_acquire))
+            return;
+
+          lazy_materializer_t materializer = nullptr;
+          {
+            std::lock_guard _lg(spinlock_exclusive_adapter::adapt(lazy.lock));
+            materializer = std::exchange(lazy.materializer, nullptr);
+            // new providers now create their attached objects right away
+            lazy.is_materializing = true;
+          }
+          if (materializer != nullptr)
+          {
+            TRACY_SCOPED_ZONE;
+            materializer(*this);
+          }
+          // only published once all the pending attached objects exist
+          lazy.is_requested.store(true, std::memory_order_release);
+        }
+
+        /// \brief Return whether the attached object type has no pending (lazy) attached objects
+        bool is_materialized(type_t id) const
+        {
+          check::debug::n_assert(id < DatabaseConf::max_attached_objects_types, "is_materialized: type-id is too big (id: {}, max: {})", id, DatabaseConf::max_attached_objects_types);
+          const lazy_type_t& lazy = lazy_types[id];
+          if (lazy.is_requested.load(std::memory_order_acquire))
+            return true;
+          std::lock_guard _lg(spinlock_shared_adapter::adapt(lazy.lock));
+          return lazy.materializer == nullptr;
+        }
+
+        void materialize(const inline_mask<DatabaseConf>& mask)
+        {
+          for (size_t j = 0; j < inline_mask<DatabaseConf>::entry_count; ++j)
+          {
+            for (uint64_t bits = mask.mask[j]; bits != 0; bits &= bits - 1)
+              materialize(type_t(j * 64 + std::countr_zero(bits)));
+          }
+        }
+
+        using lazy_materializer_t = void (*)(database&);
+
+        /// \brief Register the function that will materialize a lazy attached object type
+        /// \note Used by lazy concepts, calling this multiple times is fine (the last function is kept)
+        /// \return false if the type has already been requested (attached objects must then be created right away)
+        bool set_lazy_materializer(type_t id, lazy_materializer_t materializer)
+        {
+          check::debug::n_assert(id < DatabaseConf::max_attached_objects_types, "set_lazy_materializer: type-id is too big (id: {}, max: {})", id, DatabaseConf::max_attached_objects_types);
+          lazy_type_t& lazy = lazy_types[id];
+          std::lock_guard _lg(spinlock_exclusive_adapter::adapt(lazy.lock));
+          if (lazy.is_materializing)
+            return false;
+          lazy.materializer = materializer;
+          return true;
+        }
+
+        /// \brief Apply attached-object destruction, maintain the query caches and the active sets
         /// \warning It must be called often (something like at the beginning of frames)
         /// \warning Calling this invalidates existing queries
         /// \note inherently single-threaded
@@ -392,6 +825,8 @@ namespace neam
           {
             for (auto& it : attached_object_db)
               it.lock.lock_exclusive();
+            for (auto& it : attached_object_db)
+              flush_immediate_db(it);
           }
 
           while (!pending_attached_object_changes.empty())
@@ -428,6 +863,27 @@ namespace neam
             }
           }
 
+          // sleep / wake changes:
+          while (!pending_sleep_changes.empty())
+          {
+            weak_ref_indirection_t* indirection = nullptr;
+            if (!pending_sleep_changes.try_pop_front(indirection))
+              break;
+            if (indirection->data != nullptr)
+              update_active_sets(*indirection->data);
+            indirection->drop();
+          }
+
+          // remove the tombstones of the active sets:
+          if constexpr(DatabaseConf::use_attached_object_db)
+          {
+            for (auto& it : attached_object_db)
+            {
+              if (it.has_active_set.load(std::memory_order_relaxed) && it.active_deletion_count.exchange(0, std::memory_order_acq_rel) > 0)
+                compact_active_set(it);
+            }
+          }
+
           // unlock all db:
           if constexpr(DatabaseConf::use_attached_object_db)
           {
@@ -448,11 +904,12 @@ namespace neam
         using id_t = type_id<AO, typename DatabaseConf::attached_object_type>;
 
         template<typename AttachedObjectsList, typename Function>
-        void for_each_list(const Function& func)
+        void for_each_list(const Function& func, entity_filter filter = entity_filter::enabled_only)
         {
           using utility = typename ct::list::extract<AttachedObjectsList>::template as<attached_object_utility_t>;
 
           utility::check();
+          utility::check_materialized(*this);
           typename utility::shared_locker _sl{*this};
           std::lock_guard _l(_sl);
 
@@ -461,13 +918,17 @@ namespace neam
 
           // generates the mask
           const inline_mask<DatabaseConf> mask = utility::make_mask();
+          const bool include_disabled = filter == entity_filter::include_disabled;
 
           // for each !
           if constexpr (DatabaseConf::use_attached_object_db)
           {
-            for (auto& it : attached_object_db[attached_object_id].db)
+            const attached_object_db_t& aodb = attached_object_db[attached_object_id];
+            const size_t count = get_attached_object_count(attached_object_id);
+            for (size_t i = 0; i < count; ++i)
             {
-              if (it != nullptr && mask.match(it->owner.mask))
+              base_t* it = get_attached_object_entry(aodb, i);
+              if (it != nullptr && mask.match(it->owner.mask) && (it->owner.enabled || include_disabled))
               {
                 std::lock_guard _lg(spinlock_shared_adapter::adapt(it->owner.lock));
                 utility::call(func, *this, it->owner);
@@ -480,7 +941,7 @@ namespace neam
             for (uint32_t i = 0; i < count; ++i)
             {
               entity_data_t* data = get_entity(i);
-              if (data != nullptr && mask.match(data->mask))
+              if (data != nullptr && mask.match(data->mask) && (data->enabled || include_disabled))
               {
                 std::lock_guard _lg(spinlock_shared_adapter::adapt(data->lock));
                 utility::call(func, *this, *data);
@@ -490,11 +951,12 @@ namespace neam
         }
 
         template<typename AttachedObjectsList, typename Function>
-        void for_each_list(const Function& func) const
+        void for_each_list(const Function& func, entity_filter filter = entity_filter::enabled_only) const
         {
           using utility = typename ct::list::extract<AttachedObjectsList>::template as<attached_object_utility_t>;
 
           utility::check();
+          utility::check_materialized(*this);
           typename utility::shared_locker _sl{*this};
           std::lock_guard _l(_sl);
 
@@ -503,13 +965,17 @@ namespace neam
 
           // generates the mask
           const inline_mask<DatabaseConf> mask = utility::make_mask();
+          const bool include_disabled = filter == entity_filter::include_disabled;
 
           // for each !
           if constexpr(DatabaseConf::use_attached_object_db)
           {
-            for (auto it : attached_object_db[attached_object_id])
+            const attached_object_db_t& aodb = attached_object_db[attached_object_id];
+            const size_t count = get_attached_object_count(attached_object_id);
+            for (size_t i = 0; i < count; ++i)
             {
-              if (it != nullptr && mask.match(it->owner.mask))
+              const base_t* it = get_attached_object_entry(aodb, i);
+              if (it != nullptr && mask.match(it->owner.mask) && (it->owner.enabled || include_disabled))
               {
                 std::lock_guard _lg(spinlock_shared_adapter::adapt(it->owner.lock));
                 utility::call(func, *this, it->owner);
@@ -522,7 +988,7 @@ namespace neam
             for (uint32_t i = 0; i < count; ++i)
             {
               const entity_data_t* data = get_entity(i);
-              if (data != nullptr && mask.match(data->mask))
+              if (data != nullptr && mask.match(data->mask) && (data->enabled || include_disabled))
               {
                 std::lock_guard _lg(spinlock_shared_adapter::adapt(data->lock));
                 utility::call(func, *this, *data);
@@ -531,7 +997,123 @@ namespace neam
           }
         }
 
+        template<typename... AttachedObjects, typename KeyFunction, typename Compare>
+        std::tuple<AttachedObjects*...> select_by(const KeyFunction& key, const Compare& cmp)
+        {
+          TRACY_SCOPED_ZONE;
+          using key_t = std::remove_cvref_t<std::invoke_result_t<KeyFunction, const AttachedObjects& ...>>;
+
+          std::optional<key_t> best_key;
+          std::tuple<AttachedObjects*...> ret { static_cast<AttachedObjects*>(nullptr)... };
+          for_each_list<ct::type_list<AttachedObjects...>>([&](AttachedObjects& ... objs)
+          {
+            key_t k = key(objs...);
+            if (!best_key || cmp(k, *best_key))
+            {
+              best_key.emplace(std::move(k));
+              ret = std::tuple<AttachedObjects*...> { &objs... };
+            }
+          });
+          return ret;
+        }
+
       private:
+        uint64_t next_mask_version()
+        {
+          return mask_version_counter.fetch_add(1, std::memory_order_relaxed) + 1;
+        }
+
+        /// \brief Enable / disable an entity. Not a structural change: only the flag and the mask version are changed
+        void set_entity_enabled(entity_data_t& data, bool enabled)
+        {
+          if (data.enabled == enabled)
+            return;
+          data.enabled = enabled;
+          // match caches depend on the flag:
+          data.mask_version = next_mask_version();
+          if (enabled)
+            disabled_entity_count.fetch_sub(1, std::memory_order_release);
+          else
+            disabled_entity_count.fetch_add(1, std::memory_order_release);
+        }
+
+        /// \brief Put an entity to sleep or wake it up. The active sets are updated on the next apply_component_db_changes
+        void set_entity_sleeping(entity_data_t& data, bool sleeping)
+        {
+          if (data.sleeping.exchange(sleeping, std::memory_order_acq_rel) == sleeping)
+            return;
+
+          if constexpr(DatabaseConf::use_attached_object_db)
+          {
+            // entities being destroyed will be removed from the active sets anyway
+            if (data.in_destructor.load(std::memory_order_acquire) || data.weak_ref_indirection == nullptr)
+              return;
+            data.weak_ref_indirection->grab();
+            pending_sleep_changes.push_back(data.weak_ref_indirection.get());
+          }
+        }
+
+        // NOTE: lock (exclusive) must be held
+        // (the entity lock isn't taken, as apply_component_db_changes already expects entities not to be modified concurrently)
+        void update_active_sets(entity_data_t& data)
+        {
+          const bool sleeping = data.sleeping.load(std::memory_order_acquire);
+          for (auto& it : data.attached_objects)
+          {
+            base_t* base = it.second;
+            if (base == (base_t*)(k_poisoned_pointer) || !base->in_attached_object_db || base->authorized_destruction)
+              continue;
+            if (!attached_object_db[it.first].has_active_set.load(std::memory_order_relaxed))
+              continue;
+            if (sleeping)
+              remove_from_active_set(*base);
+            else
+              add_to_active_set(*base);
+          }
+        }
+
+        // NOTE: lock (exclusive) must be held
+        void add_to_active_set(base_t& base)
+        {
+          if (base.active_index != k_not_in_active_set)
+            return;
+          attached_object_db_t& aodb = attached_object_db[base.object_type_id];
+          base.active_index = aodb.active_db.size();
+          aodb.active_db.push_back(&base);
+        }
+
+        // NOTE: lock (shared or exclusive) must be held
+        // (with the shared lock, readers may be iterating the active set: the tombstone is written atomically)
+        void remove_from_active_set(base_t& base)
+        {
+          if (base.active_index == k_not_in_active_set)
+            return;
+          attached_object_db_t& aodb = attached_object_db[base.object_type_id];
+          std::atomic_ref<base_t*>(aodb.active_db[base.active_index]).store(nullptr, std::memory_order_release);
+          aodb.active_deletion_count.fetch_add(1, std::memory_order_release);
+          base.active_index = k_not_in_active_set;
+        }
+
+        // NOTE: lock (exclusive) must be held
+        void compact_active_set(attached_object_db_t& aodb)
+        {
+          TRACY_SCOPED_ZONE;
+          uint32_t shift = 0;
+          for (uint32_t i = 0; i < aodb.active_db.size(); ++i)
+          {
+            if (aodb.active_db[i] == nullptr)
+            {
+              ++shift;
+            }
+            else if (shift > 0)
+            {
+              aodb.active_db[i - shift] = aodb.active_db[i];
+              aodb.active_db[i - shift]->active_index = i - shift;
+            }
+          }
+          aodb.active_db.resize(aodb.active_db.size() - shift);
+        }
+
         template<typename AttachedObject>
         bool entity_has(const entity_data_t& data) const
         {
@@ -568,6 +1150,14 @@ namespace neam
           return entity_list[index];
         }
 
+        /// \brief Return the entry of an attached-object db (the entries of the immediate db are after the ones of db)
+        static base_t* get_attached_object_entry(const attached_object_db_t& aodb, size_t index)
+        {
+          if (index < aodb.db.size())
+            return aodb.db[index];
+          return aodb.immediate_db.get(index - aodb.db.size());
+        }
+
         base_t* get_attached_object(size_t index, type_t id)
         {
           if constexpr(!DatabaseConf::use_attached_object_db)
@@ -576,8 +1166,8 @@ namespace neam
             return nullptr;
           }
 
-          base_t* ret = attached_object_db[id].db[index];
-          if (ret->authorized_destruction)
+          base_t* ret = get_attached_object_entry(attached_object_db[id], index);
+          if (ret == nullptr || ret->authorized_destruction)
             return nullptr;
           return ret;
         }
@@ -590,8 +1180,8 @@ namespace neam
             return nullptr;
           }
 
-          const base_t* ret = attached_object_db[id].db[index];
-          if (ret->authorized_destruction)
+          const base_t* ret = get_attached_object_entry(attached_object_db[id], index);
+          if (ret == nullptr || ret->authorized_destruction)
             return nullptr;
           return ret;
         }
@@ -604,8 +1194,8 @@ namespace neam
             return nullptr;
           }
 
-          base_t* ret = attached_object_db[id].db[index];
-          if (ret->authorized_destruction)
+          base_t* ret = get_attached_object_entry(attached_object_db[id], index);
+          if (ret == nullptr || ret->authorized_destruction)
             return nullptr;
           return &ret->owner;
         }
@@ -618,8 +1208,22 @@ namespace neam
             return nullptr;
           }
 
-          const base_t* ret = attached_object_db[id].db[index];
-          if (ret->authorized_destruction)
+          const base_t* ret = get_attached_object_entry(attached_object_db[id], index);
+          if (ret == nullptr || ret->authorized_destruction)
+            return nullptr;
+          return &ret->owner;
+        }
+
+        entity_data_t* get_active_attached_object_owner(size_t index, type_t id)
+        {
+          if constexpr(!DatabaseConf::use_attached_object_db)
+          {
+            static_assert(DatabaseConf::use_attached_object_db, "Cannot use attached-object-db when use_attached_object_db is false");
+            return nullptr;
+          }
+
+          base_t* ret = std::atomic_ref<base_t*>(attached_object_db[id].active_db[index]).load(std::memory_order_acquire);
+          if (ret == nullptr || ret->authorized_destruction)
             return nullptr;
           return &ret->owner;
         }
@@ -658,6 +1262,8 @@ namespace neam
               entity_list[data.index]._drop(); // simply assign the pointer to nullptr
             }
             entity_deletion_count.fetch_add(1, std::memory_order_release);
+            if (!data.enabled)
+              disabled_entity_count.fetch_sub(1, std::memory_order_release);
 
             // This error mostly tells you that you have dependency cycles in your attached objects.
             // You can put a breakpoint here and look at what is inside the attached_objects vector.
@@ -665,6 +1271,9 @@ namespace neam
             // This isn't toggled by ENFIELD_ENABLE_DEBUG_CHECKS because it's a breaking error. It won't produce any code in "super-release" builds
             // where n_assert will just expand to a dummy, but stil, if that error appears this means that some of your attached objects are wrongly created.
             check::debug::n_assert(data.attached_objects.empty(), "There's still attached objects on an entity while trying to destroy it (do you have dependency cycles ?)");
+
+            if (observer != nullptr)
+              observer->on_entity_removed(data);
           }
           // free the memory
           data.~entity_data_t();
@@ -684,6 +1293,10 @@ namespace neam
 
           const type_t object_type_id = type_id<AttachedObject, typename DatabaseConf::attached_object_type>::id();
           data.mask.set(object_type_id);
+          data.mask_version = next_mask_version();
+
+          // structural changes wake the entity
+          set_entity_sleeping(data, false);
 
           // make the get/add<AttachedObject>() segfault
           // (this helps avoiding incorrect usage of partially constructed attached objects)
@@ -710,9 +1323,12 @@ namespace neam
             {
               if (ptr->force_immediate_db_change)
               {
-                // force immediate changes. slow.
-                std::lock_guard _lg(spinlock_exclusive_adapter::adapt(attached_object_db[object_type_id].lock));
-                add_to_attached_db(*ptr);
+                // force immediate changes. lock-free, unless the immediate db is full.
+                if (!add_to_immediate_db(*ptr))
+                {
+                  std::lock_guard _lg(spinlock_exclusive_adapter::adapt(attached_object_db[object_type_id].lock));
+                  add_to_attached_db(*ptr);
+                }
               }
               else
               {
@@ -721,9 +1337,25 @@ namespace neam
             }
           }
 
+          if (observer != nullptr)
+            observer->on_attached_object_created(data, object_type_id);
+
           return *ptr;
         }
 
+        /// \brief Set the externally-added flag of an attached object (see entity::add / entity::remove) and notify the observer
+        void _set_externally_added(base_t& base, entity_data_t& data, bool externally_added)
+        {
+          base.externally_added = externally_added;
+          if (observer != nullptr)
+          {
+            if (externally_added)
+              observer->on_attached_object_externally_added(data, base.object_type_id);
+            else
+              observer->on_attached_object_externally_removed(data, base.object_type_id);
+          }
+        }
+
         void _delete_ao(base_t& base, entity_data_t& data)
         {
 #if N_ENABLE_LOCK_DEBUG
@@ -731,10 +1363,17 @@ namespace neam
 #endif
           base.authorized_destruction = true;
 
+          if (observer != nullptr)
+            observer->on_attached_object_removed(data, base.object_type_id);
+
           data.remove_attached_object(base.object_type_id);
 
           // Perform the deletion
           data.mask.unset(base.object_type_id);
+          data.mask_version = next_mask_version();
+
+          // structural changes wake the entity
+          set_entity_sleeping(data, false);
 
           // destruct (always, to keep the nice C++ resource management pattern and avoid nasty surprises)
           // must be after the remove/unset
@@ -779,6 +1418,47 @@ namespace neam
           pending_attached_object_changes.push_back(&base);
         }
 
+        /// \brief Insert an attached object in the immediate db of its type (lock-free)
+        /// \return false if the immediate db is full
+        bool add_to_immediate_db(base_t& base)
+        {
+          if constexpr(!DatabaseConf::use_attached_object_db)
+          {
+            static_assert(DatabaseConf::use_attached_object_db, "Cannot use the attached_object_db when use_attached_object_db is false");
+            return false;
+          }
+
+          attached_object_db_t& aodb = attached_object_db[base.object_type_id];
+
+          // the shared lock only prevents apply_component_db_changes / optimize from running at the same time
+          std::lock_guard _lg(spinlock_shared_adapter::adapt(aodb.lock));
+          const uint32_t index = aodb.immediate_db.reserve();
+          if (index == append_segment<base_t>::k_invalid_index)
+            return false;
+
+          // readers (for-each, queries) access the bit-fields of the entry, so they must be set before it is published
+          base.index = index;
+          base.in_immediate_db = true;
+          aodb.immediate_db.publish(index, &base);
+          aodb.live_count.fetch_add(1, std::memory_order_release);
+          return true;
+        }
+
+        /// \brief Move the entries of the immediate db to the db
+        // NOTE: lock (exclusive) must be held
+        void flush_immediate_db(attached_object_db_t& aodb)
+        {
+          const uint32_t count = aodb.immediate_db.size();
+          if (count == 0)
+            return;
+          for (uint32_t i = 0; i < count; ++i)
+          {
+            if (base_t* base = aodb.immediate_db.get(i); base != nullptr)
+              add_to_attached_db(*base);
+          }
+          aodb.immediate_db.clear();
+        }
+
         // NOTE: lock (exclusive) must be held
         void add_to_attached_db(base_t& base)
         {
@@ -794,8 +1474,17 @@ namespace neam
             return;
           base.in_attached_object_db = true;
 
+          // entries of the immediate db are already accounted for
+          const bool is_counted = base.in_immediate_db;
+          base.in_immediate_db = false;
+
           base.index = attached_object_db[base.object_type_id].db.size();
           attached_object_db[base.object_type_id].db.push_back(&base);
+          if (!is_counted)
+            attached_object_db[base.object_type_id].live_count.fetch_add(1, std::memory_order_release);
+
+          if (attached_object_db[base.object_type_id].has_active_set.load(std::memory_order_relaxed) && !base.owner.sleeping.load(std::memory_order_acquire))
+            add_to_active_set(base);
         }
 
         // NOTE: lock (shared or exclusive) must be held
@@ -814,8 +1503,16 @@ namespace neam
             check::debug::n_assert(attached_object_db[base.object_type_id].db[base.index].get() == &base, "Incoherent DB state");
 
             attached_object_db[base.object_type_id].deletion_count.fetch_add(1, std::memory_order_release);
+            attached_object_db[base.object_type_id].live_count.fetch_sub(1, std::memory_order_release);
 
             attached_object_db[base.object_type_id].db[base.index]._drop();
+            remove_from_active_set(base);
+          }
+          else if (base.in_immediate_db)
+          {
+            attached_object_db[base.object_type_id].live_count.fetch_sub(1, std::memory_order_release);
+            attached_object_db[base.object_type_id].immediate_db.reset(base.index);
+            base.in_immediate_db = false;
           }
 
           auto& allocator_info = type_registry<DatabaseConf>::allocator_info();
@@ -830,8 +1527,17 @@ namespace neam
 
         cr::queue_ts<cr::queue_ts_atomic_wrapper<base_t*>> pending_attached_object_changes;
 
+        // entities that have been put to sleep / woken up since the last apply_component_db_changes
+        using weak_ref_indirection_t = typename entity_t::weak_ref_indirection_t;
+        cr::queue_ts<cr::queue_ts_atomic_wrapper<weak_ref_indirection_t*>> pending_sleep_changes;
+
+        static constexpr uint32_t k_not_in_active_set = ~0u;
+
         static constexpr uint32_t k_deletion_count_to_optimize = 1024;
 
+        // under that number of entries, parallel operations (like reduce) are not split further
+        static constexpr uint32_t k_min_entry_count_per_task = 4096;
+
         // deletion is the trigger point for re-arranging the array
         // entity_list usage is controlled by dbconf::use_entity_db
         std::atomic<uint32_t> entity_deletion_count;
@@ -840,6 +1546,46 @@ namespace neam
 
         neam::cr::memory_pool<entity_data_t> entity_data_pool;
 
+        // source of entity_data_t::mask_version
+        std::atomic<uint64_t> mask_version_counter = 0;
+
+        // number of disabled entities (the O(1) paths of count() are only valid when there are none)
+        std::atomic<uint32_t> disabled_entity_count = 0;
+
+        database_observer<DatabaseConf>* observer = nullptr;
+
+        // see materialize()
+        struct lazy_type_t
+        {
+          // set once the materialization is complete
+          std::atomic<bool> is_requested = false;
+          // set when the materialization starts (protected by lock)
+          bool is_materializing = false;
+          mutable shared_spinlock lock;
+          shared_spinlock materialization_lock;
+          lazy_materializer_t materializer = nullptr;
+        };
+        lazy_type_t lazy_types[DatabaseConf::max_attached_objects_types];
+
+        // see get_shared_object()
+        template<typename Type>
+        static constexpr char shared_object_key = 0;
+        mutable shared_spinlock shared_objects_lock;
+        std::unordered_map<const void*, std::shared_ptr<void>> shared_objects;
+
+        // lock-free cache of shared_objects, indexed by get_shared_object_slot() (types past the last slot only use the map)
+        static constexpr uint32_t k_shared_object_slot_count = 32;
+        std::array<std::atomic<void*>, k_shared_object_slot_count> shared_object_slots = {};
+
+        static inline std::atomic<uint32_t> shared_object_slot_counter = 0;
+
+        template<typename Type>
+        static uint32_t get_shared_object_slot()
+        {
+          static const uint32_t slot = shared_object_slot_counter.fetch_add(1, std::memory_order_relaxed);
+          return slot;
+        }
+
         typename DatabaseConf::attached_object_allocator allocator;
 
         friend class entity<DatabaseConf>;
@@ -0,0 +1,65 @@
+//
+// file : database_observer.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 10:27:37 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include "enfield_types.hpp"
+
+namespace neam::enfield
+{
+  /// \brief Receive the structural changes of a database (see database::set_observer())
+  /// \note Entities are modified under their own lock, so the callbacks can be called from multiple threads at once
+  /// \note The callbacks are called with the entity lock held (exclusively), and must not modify the database
+  template<typename DatabaseConf>
+  class database_observer
+  {
+    public:
+      virtual ~database_observer() = default;
+
+    protected:
+      using entity_data_t = typename entity<DatabaseConf>::data_t;
+
+      /// \brief Called after the entity has been created
+      virtual void on_entity_created(entity_data_t& /*data*/) {}
+      /// \brief Called after all the attached objects of the entity have been removed, right before the entity is destroyed
+      virtual void on_entity_removed(entity_data_t& /*data*/) {}
+      /// \brief Called after an attached object has been constructed
+      virtual void on_attached_object_created(entity_data_t& /*data*/, type_t /*object_type_id*/) {}
+      /// \brief Called before an attached object is destructed
+      virtual void on_attached_object_removed(entity_data_t& /*data*/, type_t /*object_type_id*/) {}
+      /// \brief Called after an attached object has been externally added (entity::add), either created or already present as a dependency
+      /// \note Unlike on_attached_object_created, this is not called for the attached objects created by require<>()
+      virtual void on_attached_object_externally_added(entity_data_t& /*data*/, type_t /*object_type_id*/) {}
+      /// \brief Called when an attached object stops being externally added (entity::remove), before it is destructed (if it is)
+      virtual void on_attached_object_externally_removed(entity_data_t& /*data*/, type_t /*object_type_id*/) {}
+
+      static entity_data_t& get_entity_data(entity<DatabaseConf>& entity) { return *entity.data; }
+
+      friend class database<DatabaseConf>;
+  };
+}
@@ -46,6 +46,13 @@ namespace neam
       any,
     };
 
+    /// \brief Which entities are iterated over by for-each, queries, ... (see entity::set_enabled())
+    enum class entity_filter
+    {
+      enabled_only, // skip disabled entities (default)
+      include_disabled,
+    };
+
     enum class for_each
     {
       next, // conitnue (default if the function returns void)
@@ -57,6 +64,7 @@ namespace neam
     template<typename DatabaseConf> class base_system;
     template<typename DatabaseConf> class system_manager;
     template<typename DatabaseConf> class entity;
+    template<typename DatabaseConf> class database_observer;
 
     template<typename DatabaseConf, typename... AttachedObjects> struct attached_object_utility;
 
@@ -127,6 +127,15 @@ namespace neam
           /// \brief Allow a quick query of the components this entity has
           inline_mask<DatabaseConf> mask;
 
+          /// \brief Disabled entities are skipped by systems, for-each and queries (see entity::set_enabled())
+          bool enabled = true;
+
+          /// \brief Changed every time the mask changes. Unique across the DB, so can be used to cache mask-dependent results
+          uint64_t mask_version = 0;
+
+          /// \brief Sleeping entities are not in the active sets (see entity::sleep())
+          std::atomic<bool> sleeping = false;
+
           /// \brief The list of attached_objects this entity have
           /// (we use a linear array as we don't expect that there will be more than 100 components on most entities)
           std::mtc_vector<std::pair<type_t, base_t*>> attached_objects;
@@ -336,7 +345,7 @@ namespace neam
           check::debug::n_assert(ret != nullptr, "The attached object is invalid (dependency cycle?)");
           base_t* bptr = ret;
           check::debug::n_assert(bptr->externally_added == false, "The attached object is already present and has already been externally-requested");
-          bptr->externally_added = true;
+          data->db._set_externally_added(*bptr, *data, true);
           return *ret;
         }
 
@@ -357,7 +366,7 @@ namespace neam
           AttachedObject& obj = *data->template slow_get<AttachedObject>();
           base_t* bptr = &obj;
           check::debug::n_assert(bptr->externally_added == true, "The attached object is has not been externally-requested");
-          bptr->externally_added = false;
+          data->db._set_externally_added(*bptr, *data, false);
 
           if (bptr->can_be_destructed())
             data->db._delete_ao(*bptr, *data);
@@ -412,6 +421,48 @@ namespace neam
           return data->template has<AttachedObject>();
         }
 
+        /// \brief Enable or disable the entity. Disabled entities are skipped by systems, for-each and queries
+        /// (unless they opt-in with entity_filter::include_disabled / base_system::include_disabled_entities)
+        /// \note This isn't a structural change: attached objects are kept as-is, so it's cheap to toggle
+        void set_enabled(bool enabled)
+        {
+          check::debug::n_assert(is_valid(), "entity::set_enabled: entity is not valid");
+#if N_ENABLE_LOCK_DEBUG
+          check::debug::n_assert(data->lock._debug_is_exclusive_lock_held_by_current_thread(), "entity::set_enabled: expecting exclusive lock to be held by current thread");
+#endif
+          data->db.set_entity_enabled(*data, enabled);
+        }
+
+        /// \brief Return whether the entity is enabled (see set_enabled())
+        [[nodiscard]] bool is_enabled() const
+        {
+          check::debug::n_assert(is_valid(), "entity::is_enabled: entity is not valid");
+          return data->enabled;
+        }
+
+        /// \brief Put the entity to sleep: systems with use_active_set will skip it until it is woken up
+        /// \note Adding or removing an attached object wakes the entity
+        /// \note The active sets are updated on the next database::apply_component_db_changes
+        void sleep()
+        {
+          check::debug::n_assert(is_valid(), "entity::sleep: entity is not valid");
+          data->db.set_entity_sleeping(*data, true);
+        }
+
+        /// \brief Wake the entity up (see sleep())
+        void wake()
+        {
+          check::debug::n_assert(is_valid(), "entity::wake: entity is not valid");
+          data->db.set_entity_sleeping(*data, false);
+        }
+
+        /// \brief Return whether the entity is sleeping (see sleep())
+        [[nodiscard]] bool is_sleeping() const
+        {
+          check::debug::n_assert(is_valid(), "entity::is_sleeping: entity is not valid");
+          return data->sleeping.load(std::memory_order_acquire);
+        }
+
         /// \brief Return the current database of the entity
         database_t& get_database()
         {
@@ -460,6 +511,7 @@ namespace neam
         friend class system_manager<DatabaseConf>;
         template<typename DBC, typename... AttachedObjects> friend struct attached_object_utility;
         friend entity_weak_ref<DatabaseConf>;
+        friend class database_observer<DatabaseConf>;
     };
 
     /// \brief Weak ref for entities
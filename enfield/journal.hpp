@@ -0,0 +1,432 @@
+//
+// file : journal.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 10:27:37 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <atomic>
+#include <cstdio>
+#include <cstring>
+#include <memory>
+#include <span>
+#include <thread>
+#include <vector>
+#include <utility>
+#include <unordered_map>
+
+#include "database.hpp"
+#include "entity.hpp"
+#include "database_observer.hpp"
+#include "mapped_file.hpp"
+#include "concept/serializable.hpp"
+
+namespace neam::enfield
+{
+  /// \brief Append-only binary log of the changes of a database, for replays and crash recovery
+  /// Entity creation / destruction and the external addition / removal of serializable attached objects (entity::add / entity::remove)
+  /// are recorded automatically (see database::set_observer()), the serialized state of entities is recorded with record_state().
+  /// Attached objects created by require<>() are not recorded: on replay, they are created by the attached objects requiring them.
+  ///
+  /// Records are buffered per thread (so recording does not serialize the threads changing the database),
+  /// and are merged in order and written to the file as a single frame by commit() (group commit), which should be called once per frame.
+  /// Frames have a checksum, so a frame partially written during a crash is ignored by replay().
+  ///
+  /// To start a journal from a snapshot, call add_existing_entities() with the restored entities
+  /// (and pass them to replay() in the same order).
+  ///
+  /// \note Only serializable attached objects are recorded (see serializable::is_serializable_type()), so every record can be replayed.
+  ///       Attached objects added on replay are default constructed: their data comes from the following states.
+  template<typename DatabaseConf>
+  class journal : public database_observer<DatabaseConf>
+  {
+    private:
+      using serializable = concepts::serializable<DatabaseConf>;
+      using entity_data_t = typename database_observer<DatabaseConf>::entity_data_t;
+
+    public:
+      enum class record_type : uint8_t
+      {
+        entity_created,
+        entity_removed,
+        entity_existing, // value is the index of the entity passed to add_existing_entities()
+        attached_object_added, // value is the type hash (the attached object has been externally added, see entity::add)
+        attached_object_removed, // value is the type hash (the attached object is not externally added anymore, see entity::remove)
+        entity_state, // value is the size of the payload (the output of serializable::serialize())
+        entity_delta, // value is the size of the payload (the output of serializable::serialize_delta())
+      };
+
+      /// \brief Create the journal file (truncating it) and start observing the database
+      journal(database<DatabaseConf>& _db, const char* path) : db(_db), file(std::fopen(path, "wb"))
+      {
+        if (file != nullptr)
+          db.set_observer(this);
+      }
+
+      journal(const journal&) = delete;
+      journal& operator = (const journal&) = delete;
+
+      ~journal()
+      {
+        if (file != nullptr)
+        {
+          db.set_observer(nullptr);
+          commit();
+          std::fclose(file);
+        }
+      }
+
+      bool is_open() const { return file != nullptr; }
+
+      /// \brief Whether attached object additions / removals are recorded
+      bool record_attached_object_changes = true;
+
+      /// \brief Record the entities (restored from a snapshot, ...) as the initial entities of the journal
+      /// replay() must then be called with the same entities, in the same order
+      void add_existing_entities(std::span<entity<DatabaseConf>> entities)
+      {
+        for (uint64_t i = 0; i < entities.size(); ++i)
+          write_record(record_type::entity_existing, get_entity_id(this->get_entity_data(entities[i])), i);
+      }
+
+      /// \brief Record the serialized state of an entity (see serializable::serialize())
+      /// \param delta Only record the attached objects that changed since the last delta (see serializable::serialize_delta())
+      /// \note The entity lock must be held
+      void record_state(entity<DatabaseConf>& entity, bool delta = false)
+      {
+        serializable* concept_ptr = entity.template get<serializable>();
+        if (concept_ptr == nullptr)
+          return;
+
+        rle::status st = rle::status::success;
+        const raw_data data = delta ? concept_ptr->serialize_delta(st) : concept_ptr->serialize(st);
+        if (st == rle::status::failure || data.size == 0)
+          return;
+
+        write_record(delta ? record_type::entity_delta : record_type::entity_state, get_entity_id(this->get_entity_data(entity)), data.size,
+                     { reinterpret_cast<const uint8_t*>(data.data.get()), data.size });
+      }
+
+      /// \brief Write all the pending records to the file, as a single frame
+      /// \param flush Also flush the file
+      /// \return false if the write failed
+      /// \warning Must not be called concurrently with itself
+      bool commit(bool flush = true)
+      {
+        TRACY_SCOPED_ZONE;
+
+        // grab the records of every thread:
+        std::vector<std::vector<uint8_t>> thread_records;
+        {
+          std::lock_guard _lg(spinlock_shared_adapter::adapt(thread_buffers_lock));
+          thread_records.reserve(thread_buffers.size());
+          for (auto& it : thread_buffers)
+          {
+            std::lock_guard _blg(spinlock_exclusive_adapter::adapt(it->lock));
+            if (!it->records.empty())
+              thread_records.emplace_back().swap(it->records);
+          }
+        }
+        if (thread_records.empty())
+          return true;
+
+        // merge them in order:
+        struct record_ref_t
+        {
+          uint64_t sequence;
+          const uint8_t* data;
+          size_t size;
+        };
+        std::vector<record_ref_t> records;
+        size_t frame_size = 0;
+        for (const std::vector<uint8_t>& it : thread_records)
+        {
+          for (size_t offset = 0; offset < it.size();)
+          {
+            record_header header;
+            std::memcpy(&header, it.data() + offset, sizeof(header));
+            const size_t size = sizeof(header) + get_payload_size(header);
+            records.push_back({ header.sequence, it.data() + offset, size });
+            offset += size;
+            frame_size += size;
+          }
+        }
+        std::sort(records.begin(), records.end(), [](const record_ref_t& a, const record_ref_t& b) { return a.sequence < b.sequence; });
+
+        std::vector<uint8_t> frame;
+        frame.reserve(frame_size);
+        for (const record_ref_t& it : records)
+          frame.insert(frame.end(), it.data, it.data + it.size);
+
+        const frame_header header { k_frame_magic, (uint32_t)records.size(), frame.size(), concepts::internal::hash_data(frame) };
+        bool success = std::fwrite(&header, sizeof(header), 1, file) == 1;
+        success = success && std::fwrite(frame.data(), 1, frame.size(), file) == frame.size();
+        if (flush)
+          success = success && std::fflush(file) == 0;
+        return success;
+      }
+
+      /// \brief Recreate the entities recorded in a journal file
+      /// Stops at the first incomplete or corrupted frame (like the last frame of a process that crashed),
+      /// or at the first frame with a record that cannot be replayed (an unknown attached object type)
+      /// \param initial_entities The entities that were passed to add_existing_entities(), in the same order
+      /// \return The entities alive at the end of the journal, indexed by their journal id
+      static std::unordered_map<uint64_t, entity<DatabaseConf>> replay(database<DatabaseConf>& db, const char* path, std::vector<entity<DatabaseConf>> initial_entities = {})
+      {
+        TRACY_SCOPED_ZONE;
+        std::unordered_map<uint64_t, entity<DatabaseConf>> entities;
+
+        const mapped_file file(path);
+        if (!file.is_valid())
+          return entities;
+
+        std::span<const uint8_t> data = file.get_data();
+        while (data.size() >= sizeof(frame_header))
+        {
+          frame_header header;
+          std::memcpy(&header, data.data(), sizeof(header));
+          if (header.magic != k_frame_magic || header.size > data.size() - sizeof(header))
+            break;
+
+          const std::span<const uint8_t> frame = data.subspan(sizeof(header), header.size);
+          if (concepts::internal::hash_data(frame) != header.checksum)
+            break;
+          if (!replay_frame(db, frame, header.record_count, entities, initial_entities))
+            break;
+
+          data = data.subspan(sizeof(header) + header.size);
+        }
+        return entities;
+      }
+
+    protected:
+      void on_entity_created(entity_data_t& data) final override
+      {
+        write_record(record_type::entity_created, get_entity_id(data), 0);
+      }
+
+      void on_entity_removed(entity_data_t& data) final override
+      {
+        write_record(record_type::entity_removed, get_entity_id(data), 0);
+      }
+
+      // only the externally added attached objects are recorded: the other ones are created by their dependencies on replay
+      void on_attached_object_externally_added(entity_data_t& data, type_t object_type_id) final override
+      {
+        if (!record_attached_object_changes)
+          return;
+        const uint64_t type_hash = type_registry<DatabaseConf>::debug_info()[object_type_id].type_hash;
+        if (serializable::is_serializable_type(type_hash))
+          write_record(record_type::attached_object_added, get_entity_id(data), type_hash);
+      }
+
+      void on_attached_object_externally_removed(entity_data_t& data, type_t object_type_id) final override
+      {
+        if (!record_attached_object_changes)
+          return;
+        const uint64_t type_hash = type_registry<DatabaseConf>::debug_info()[object_type_id].type_hash;
+        if (serializable::is_serializable_type(type_hash))
+          write_record(record_type::attached_object_removed, get_entity_id(data), type_hash);
+      }
+
+    private:
+      static constexpr uint32_t k_frame_magic = 0x334C524A; // JRL3
+
+      struct frame_header
+      {
+        uint32_t magic;
+        uint32_t record_count;
+        uint64_t size;
+        uint64_t checksum;
+      };
+
+      struct record_header
+      {
+        record_type type;
+        uint8_t _padding[7] = {};
+        // global order of the records (records of the same entity are written under its lock, so they are ordered)
+        uint64_t sequence;
+        uint64_t entity_id;
+        uint64_t value;
+      };
+
+      static uint64_t get_payload_size(const record_header& header)
+      {
+        if (header.type == record_type::entity_state || header.type == record_type::entity_delta)
+          return header.value;
+        return 0;
+      }
+
+      /// \brief The records of a single thread (only locked by its thread and by commit())
+      struct thread_buffer_t
+      {
+        std::thread::id thread_id;
+        shared_spinlock lock;
+        std::vector<uint8_t> records;
+      };
+
+      /// \brief Return the buffer of the current thread
+      thread_buffer_t& get_thread_buffer()
+      {
+        // cache of the last journal the thread has written to (the journal id is never reused, unlike the address)
+        struct cache_t
+        {
+          uint64_t journal_id = 0;
+          thread_buffer_t* buffer = nullptr;
+        };
+        static thread_local cache_t cache;
+        if (cache.journal_id == journal_id)
+          return *cache.buffer;
+
+        const std::thread::id thread_id = std::this_thread::get_id();
+        thread_buffer_t* buffer = nullptr;
+        {
+          std::lock_guard _lg(spinlock_exclusive_adapter::adapt(thread_buffers_lock));
+          for (auto& it : thread_buffers)
+          {
+            if (it->thread_id == thread_id)
+              buffer = it.get();
+          }
+          if (buffer == nullptr)
+          {
+            buffer = thread_buffers.emplace_back(std::make_unique<thread_buffer_t>()).get();
+            buffer->thread_id = thread_id;
+          }
+        }
+        cache = { journal_id, buffer };
+        return *buffer;
+      }
+
+      void write_record(record_type type, uint64_t entity_id, uint64_t value, std::span<const uint8_t> payload = {})
+      {
+        const record_header record { type, {}, next_sequence.fetch_add(1, std::memory_order_relaxed), entity_id, value };
+        const uint8_t* const ptr = reinterpret_cast<const uint8_t*>(&record);
+
+        thread_buffer_t& buffer = get_thread_buffer();
+        std::lock_guard _lg(spinlock_exclusive_adapter::adapt(buffer.lock));
+        buffer.records.insert(buffer.records.end(), ptr, ptr + sizeof(record));
+        buffer.records.insert(buffer.records.end(), payload.begin(), payload.end());
+      }
+
+      /// \brief Return the journal id of an entity
+      /// The address of the entity data is used: it is unique among the live entities, and the removal of an entity
+      /// is always recorded before its address can be reused
+      static uint64_t get_entity_id(const entity_data_t& data)
+      {
+        return (uint64_t)reinterpret_cast<uintptr_t>(&data);
+      }
+
+      static bool replay_frame(database<DatabaseConf>& db, std::span<const uint8_t> frame, uint32_t record_count,
+                               std::unordered_map<uint64_t, entity<DatabaseConf>>& entities,
+                               std::vector<entity<DatabaseConf>>& initial_entities)
+      {
+        // entities that were not created in the journal (nor added with add_existing_entities) are created on first use
+        const auto get_entity = [&](uint64_t entity_id) -> entity<DatabaseConf>&
+        {
+          auto it = entities.find(entity_id);
+          if (it == entities.end())
+            it = entities.emplace(entity_id, db.create_entity()).first;
+          return it->second;
+        };
+
+        for (uint32_t i = 0; i < record_count; ++i)
+        {
+          record_header record;
+          if (frame.size() < sizeof(record))
+            return false;
+          std::memcpy(&record, frame.data(), sizeof(record));
+          frame = frame.subspan(sizeof(record));
+
+          switch (record.type)
+          {
+            case record_type::entity_created:
+              entities.insert_or_assign(record.entity_id, db.create_entity());
+              break;
+            case record_type::entity_removed:
+              entities.erase(record.entity_id);
+              break;
+            case record_type::entity_existing:
+              if (record.value >= initial_entities.size() || !initial_entities[record.value].is_valid())
+                return false;
+              entities.insert_or_assign(record.entity_id, std::move(initial_entities[record.value]));
+              break;
+            case record_type::attached_object_added:
+            case record_type::attached_object_removed:
+            {
+              entity<DatabaseConf>& entity = get_entity(record.entity_id);
+              std::lock_guard _lg(spinlock_exclusive_adapter::adapt(entity.get_lock()));
+              const bool success = record.type == record_type::attached_object_added
+                                   ? serializable::add_by_type_hash(entity, record.value)
+                                   : serializable::remove_by_type_hash(entity, record.value);
+              if (!success)
+              {
+                check::debug::n_check(false, "journal::replay: unknown attached object type (type hash: {})", record.value);
+                return false;
+              }
+              break;
+            }
+            case record_type::entity_state:
+            case record_type::entity_delta:
+            {
+              if (record.value > frame.size())
+                return false;
+
+              raw_data payload = raw_data::allocate(record.value);
+              std::memcpy(payload.data.get(), frame.data(), record.value);
+
+              entity<DatabaseConf>& entity = get_entity(record.entity_id);
+              std::lock_guard _lg(spinlock_exclusive_adapter::adapt(entity.get_lock()));
+              rle::status st = rle::status::success;
+              if (record.type == record_type::entity_state)
+                serializable::deserialize(entity, payload);
+              else if (serializable* concept_ptr = entity.template get<serializable>(); concept_ptr != nullptr)
+                concept_ptr->apply_delta(entity, payload, st);
+              else
+                serializable::deserialize_delta(entity, payload, st);
+
+              frame = frame.subspan(record.value);
+              break;
+            }
+            default:
+              return false;
+          }
+        }
+        return true;
+      }
+
+    private:
+      database<DatabaseConf>& db;
+      std::FILE* file = nullptr;
+
+      static inline std::atomic<uint64_t> next_journal_id = 1;
+      const uint64_t journal_id = next_journal_id.fetch_add(1, std::memory_order_relaxed);
+      std::atomic<uint64_t> next_sequence = 0;
+
+      shared_spinlock thread_buffers_lock;
+      std::vector<std::unique_ptr<thread_buffer_t>> thread_buffers;
+  };
+}
@@ -0,0 +1,108 @@
+//
+// file : mapped_file.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 10:21:19 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <span>
+#include <cstdint>
+#include <utility>
+
+#if __has_include(<sys/mman.h>)
+#include <fcntl.h>
+#include <unistd.h>
+#include <sys/mman.h>
+#include <sys/stat.h>
+#define ENFIELD_HAS_MMAP 1
+#else
+#define ENFIELD_HAS_MMAP 0
+#endif
+
+namespace neam::enfield
+{
+  /// \brief Read-only memory mapping of a whole file
+  /// \note On platforms without mmap, the file is never valid
+  class mapped_file
+  {
+    public:
+      mapped_file() = default;
+      explicit mapped_file(const char* path)
+      {
+#if ENFIELD_HAS_MMAP
+        const int fd = ::open(path, O_RDONLY);
+        if (fd < 0)
+          return;
+
+        struct stat st;
+        if (::fstat(fd, &st) == 0 && st.st_size > 0)
+        {
+          void* ptr = ::mmap(nullptr, (size_t)st.st_size, PROT_READ, MAP_PRIVATE, fd, 0);
+          if (ptr != MAP_FAILED)
+          {
+            data = static_cast<const uint8_t*>(ptr);
+            size = (size_t)st.st_size;
+            ::madvise(ptr, size, MADV_SEQUENTIAL);
+          }
+        }
+        ::close(fd);
+#else
+        (void)path;
+#endif
+      }
+
+      mapped_file(mapped_file&& o) : data(std::exchange(o.data, nullptr)), size(std::exchange(o.size, 0)) {}
+      mapped_file& operator = (mapped_file&& o)
+      {
+        if (&o == this)
+          return *this;
+        unmap();
+        data = std::exchange(o.data, nullptr);
+        size = std::exchange(o.size, 0);
+        return *this;
+      }
+
+      ~mapped_file() { unmap(); }
+
+      bool is_valid() const { return data != nullptr; }
+      std::span<const uint8_t> get_data() const { return { data, size }; }
+
+    private:
+      void unmap()
+      {
+#if ENFIELD_HAS_MMAP
+        if (data != nullptr)
+          ::munmap(const_cast<uint8_t*>(data), size);
+#endif
+        data = nullptr;
+        size = 0;
+      }
+
+    private:
+      const uint8_t* data = nullptr;
+      size_t size = 0;
+  };
+}
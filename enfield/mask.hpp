@@ -69,6 +69,17 @@ namespace neam::enfield
       return true;
     }
 
+    // perform (*this & other) != 0
+    bool intersects(const inline_mask& o) const
+    {
+      for (size_t j = 0; j < entry_count; ++j)
+      {
+        if ((mask[j] & o.mask[j]) != 0)
+          return true;
+      }
+      return false;
+    }
+
     void set(type_t id)
     {
       const uint32_t index = id / 64;
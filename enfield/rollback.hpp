@@ -0,0 +1,308 @@
+//
+// file : rollback.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 10:31:49 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+
+#include <array>
+#include <vector>
+#include <cstring>
+#include <utility>
+
+#include "database.hpp"
+#include "entity.hpp"
+#include "concept/serializable.hpp"
+
+namespace neam::enfield
+{
+  /// \brief Keep the state of some attached objects for the last N frames, and restore any of those frames in place
+  /// (for rollback netcode: restore the last confirmed frame, then re-simulate)
+  ///
+  /// Only the entities created through the rollback buffer are tracked (it owns them).
+  /// Removed entities are only disabled while they are inside the window, so their removal can be reverted;
+  /// entities created after the restored frame are removed.
+  ///
+  /// Attached objects with a trivially copyable data member (like data_holder) are copied as-is in packed columns,
+  /// the other ones must have metadata and are serialized / deserialized in-place with rle (like the serializable concept does).
+  /// \note Tracked attached objects that are added on restore are added without arguments,
+  ///       and only the attached objects that have been externally added are removed on restore
+  template<typename DatabaseConf, typename... AttachedObjects>
+  class rollback_buffer
+  {
+    public:
+      using entity_id_t = uint32_t;
+      static constexpr entity_id_t k_invalid_entity_id = ~entity_id_t(0);
+
+      /// \param frame_count The number of frames that can be restored
+      rollback_buffer(database<DatabaseConf>& _db, uint32_t frame_count) : db(_db), frames(frame_count)
+      {
+        check::debug::n_assert(frame_count > 0, "rollback_buffer: frame_count must not be 0");
+      }
+
+      rollback_buffer(const rollback_buffer&) = delete;
+      rollback_buffer& operator = (const rollback_buffer&) = delete;
+
+      /// \brief Create an entity owned by the rollback buffer (the creation is reverted if a previous frame is restored)
+      entity_id_t create_entity()
+      {
+        entity_id_t id;
+        if (!free_ids.empty())
+        {
+          id = free_ids.back();
+          free_ids.pop_back();
+        }
+        else
+        {
+          id = (entity_id_t)slots.size();
+          slots.emplace_back();
+        }
+        slots[id] = { db.create_entity(), next_frame, k_alive };
+        return id;
+      }
+
+      /// \brief Remove an entity. The entity is disabled, and only destroyed once it has left the window.
+      void remove_entity(entity_id_t id)
+      {
+        entity<DatabaseConf>* ent = get_entity(id);
+        if (ent == nullptr)
+          return;
+
+        std::lock_guard _lg(spinlock_exclusive_adapter::adapt(ent->get_lock()));
+        ent->set_enabled(false);
+        slots[id].removed_frame = next_frame;
+      }
+
+      /// \brief Return the entity (nullptr if it does not exist or has been removed)
+      entity<DatabaseConf>* get_entity(entity_id_t id)
+      {
+        if (id >= slots.size() || !slots[id].ent.is_valid() || slots[id].removed_frame != k_alive)
+          return nullptr;
+        return &slots[id].ent;
+      }
+
+      /// \brief Save the state of the tracked attached objects
+      /// \return The index of the captured frame (to pass to restore())
+      uint64_t capture()
+      {
+        TRACY_SCOPED_ZONE;
+        const uint64_t frame_index = next_frame++;
+        if (next_frame - first_frame > frames.size())
+          ++first_frame;
+
+        frame_t& frame = frames[frame_index % frames.size()];
+        [&]<size_t... Indices>(std::index_sequence<Indices...>)
+        {
+          (capture_column<AttachedObjects>(frame.columns[Indices]), ...);
+        } (std::index_sequence_for<AttachedObjects...>{});
+
+        // removals that left the window can no longer be reverted:
+        for (entity_id_t id = 0; id < slots.size(); ++id)
+        {
+          if (slots[id].ent.is_valid() && slots[id].removed_frame <= first_frame)
+            free_slot(id);
+        }
+        return frame_index;
+      }
+
+      /// \brief Whether the frame can be restored
+      bool has_frame(uint64_t frame_index) const
+      {
+        return frame_index >= first_frame && frame_index < next_frame;
+      }
+
+      /// \brief Restore a captured frame in place
+      /// Entities created after that frame are removed, entities removed after that frame are re-enabled,
+      /// and the tracked attached objects are set back to their state (added / removed as needed).
+      /// The frames after \e frame_index are discarded (the next capture() will be frame_index + 1).
+      /// \return false if the frame is not in the window anymore
+      bool restore(uint64_t frame_index)
+      {
+        TRACY_SCOPED_ZONE;
+        if (!has_frame(frame_index))
+          return false;
+
+        for (entity_id_t id = 0; id < slots.size(); ++id)
+        {
+          slot_t& slot = slots[id];
+          if (!slot.ent.is_valid())
+            continue;
+
+          if (slot.created_frame > frame_index)
+          {
+            free_slot(id);
+          }
+          else if (slot.removed_frame != k_alive && slot.removed_frame > frame_index)
+          {
+            std::lock_guard _lg(spinlock_exclusive_adapter::adapt(slot.ent.get_lock()));
+            slot.ent.set_enabled(true);
+            slot.removed_frame = k_alive;
+          }
+        }
+
+        const frame_t& frame = frames[frame_index % frames.size()];
+        [&]<size_t... Indices>(std::index_sequence<Indices...>)
+        {
+          (restore_column<AttachedObjects>(frame.columns[Indices]), ...);
+        } (std::index_sequence_for<AttachedObjects...>{});
+
+        next_frame = frame_index + 1;
+        return true;
+      }
+
+    private:
+      static constexpr uint64_t k_alive = ~uint64_t(0);
+
+      /// \brief Whether the attached object can be saved with a simple copy of its data member
+      template<typename AttachedObject>
+      static constexpr bool has_trivially_copyable_data()
+      {
+        if constexpr (requires(const AttachedObject& o) { { o.data } -> std::same_as<const typename AttachedObject::data_t&>; })
+          return std::is_trivially_copyable_v<typename AttachedObject::data_t>;
+        else
+          return false;
+      }
+
+      static_assert(((has_trivially_copyable_data<AttachedObjects>() || metadata::concepts::StructWithMetadata<AttachedObjects>) && ...),
+                    "rollback_buffer: attached objects must either have a trivially copyable data member or have metadata");
+
+      struct slot_t
+      {
+        entity<DatabaseConf> ent;
+        uint64_t created_frame = 0;
+        uint64_t removed_frame = k_alive;
+      };
+
+      /// \brief The state of an attached object type in a frame
+      /// \note The vectors are reused from frame to frame, so steady-state captures of trivially copyable attached objects don't allocate.
+      ///       Attached objects with metadata still allocate one payload per object and per capture.
+      struct column_t
+      {
+        std::vector<entity_id_t> entity_ids;
+        // packed data members (for attached objects with a trivially copyable data member)
+        std::vector<uint8_t> data;
+        // serialized attached objects (for the other ones)
+        std::vector<raw_data> payloads;
+      };
+
+      struct frame_t
+      {
+        std::array<column_t, sizeof...(AttachedObjects)> columns;
+      };
+
+      template<typename AttachedObject>
+      void capture_column(column_t& column)
+      {
+        column.entity_ids.clear();
+        column.data.clear();
+        column.payloads.clear();
+
+        for (entity_id_t id = 0; id < slots.size(); ++id)
+        {
+          slot_t& slot = slots[id];
+          if (!slot.ent.is_valid() || slot.removed_frame != k_alive)
+            continue;
+
+          std::lock_guard _lg(spinlock_shared_adapter::adapt(slot.ent.get_lock()));
+          const AttachedObject* object = slot.ent.template get<AttachedObject>();
+          if (object == nullptr)
+            continue;
+
+          column.entity_ids.push_back(id);
+          if constexpr (has_trivially_copyable_data<AttachedObject>())
+          {
+            const uint8_t* const ptr = reinterpret_cast<const uint8_t*>(&object->data);
+            column.data.insert(column.data.end(), ptr, ptr + sizeof(object->data));
+          }
+          else
+          {
+            rle::status st = rle::status::success;
+            column.payloads.push_back(rle::serialize(*object, &st));
+            check::debug::n_check(st != rle::status::failure, "rollback_buffer: failed to serialize {}", ct::type_name<AttachedObject>.str);
+          }
+        }
+      }
+
+      template<typename AttachedObject>
+      void restore_column(const column_t& column)
+      {
+        std::vector<bool> present(slots.size(), false);
+        for (uint32_t i = 0; i < column.entity_ids.size(); ++i)
+        {
+          const entity_id_t id = column.entity_ids[i];
+          present[id] = true;
+
+          entity<DatabaseConf>& ent = slots[id].ent;
+          std::lock_guard _lg(spinlock_exclusive_adapter::adapt(ent.get_lock()));
+          AttachedObject* object = ent.template get<AttachedObject>();
+          if (object == nullptr)
+            object = &ent.template add<AttachedObject>();
+
+          if constexpr (has_trivially_copyable_data<AttachedObject>())
+          {
+            std::memcpy(&object->data, column.data.data() + i * sizeof(object->data), sizeof(object->data));
+          }
+          else
+          {
+            rle::status st = rle::in_place_deserialize(column.payloads[i], *object);
+            check::debug::n_check(st != rle::status::failure, "rollback_buffer: failed to deserialize {}", ct::type_name<AttachedObject>.str);
+          }
+        }
+
+        // remove the attached objects added after the frame:
+        for (entity_id_t id = 0; id < slots.size(); ++id)
+        {
+          entity<DatabaseConf>& ent = slots[id].ent;
+          if (present[id] || !ent.is_valid() || slots[id].removed_frame != k_alive)
+            continue;
+
+          std::lock_guard _lg(spinlock_exclusive_adapter::adapt(ent.get_lock()));
+          // attached objects that are only required by other attached objects are owned by them, not by the rollback buffer
+          const AttachedObject* object = ent.template get<AttachedObject>();
+          if (object != nullptr && object->is_externally_added())
+            ent.template remove<AttachedObject>();
+        }
+      }
+
+      void free_slot(entity_id_t id)
+      {
+        slots[id] = {};
+        free_ids.push_back(id);
+      }
+
+    private:
+      database<DatabaseConf>& db;
+
+      std::vector<slot_t> slots;
+      std::vector<entity_id_t> free_ids;
+
+      // ring buffer: frame i is at frames[i % frames.size()]
+      std::vector<frame_t> frames;
+      uint64_t first_frame = 0;
+      uint64_t next_frame = 0;
+  };
+}
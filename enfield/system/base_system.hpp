@@ -30,10 +30,18 @@
 #pragma once
 
 #include <string>
+#include <atomic>
+#include <chrono>
+#include <span>
+#include <vector>
+#include <type_traits>
 
 #include "../enfield_types.hpp"
 #include "../type_id.hpp"
 #include "../attached_object_utility.hpp"
+#include "run_cost.hpp"
+#include "parallel_for.hpp"
+#include "system_stats.hpp"
 #include <ntools/ct_list.hpp>
 
 namespace neam
@@ -73,23 +81,113 @@ namespace neam
         ///          and *will* skip all transient ones.
         /// \note when only matching concepts, setting this to true should (most of the time) only yield better perfs.
         ///
-        /// \note some system execution modes might not respect this flag
+        /// \note when multiple systems share a pass, the attached-object db is only used if all of them set this flag
         bool should_use_attached_object_db = false;
 
+        /// \brief If not 0, the number of entities each task will process
+        /// (otherwise it is computed from the measured cost of the system and the target task duration of the system manager)
+        /// \note when multiple systems share a pass, the smallest value is used
+        uint32_t entity_per_task = 0;
+
+        /// \brief If not 0, the maximum number of tasks that will run the system concurrently
+        /// (otherwise the limit of the system manager is used)
+        /// \note when multiple systems share a pass, the smallest value is used
+        uint32_t max_task_count = 0;
+
+        /// \brief (pipelined mode) The number of chunks on each side of a chunk the system depends on:
+        /// before processing a chunk, the previous systems must have processed it and its neighbours.
+        /// \note All the systems of the pipeline use the same chunks (the smallest chunk size of the systems, see entity_per_task)
+        uint32_t pipeline_neighbour_chunks = 0;
+
+        /// \brief If true, the system also runs on disabled entities (see entity::set_enabled())
+        bool include_disabled_entities = false;
+
+        /// \brief If true, sleeping entities are skipped (see entity::sleep()).
+        /// When iterating over the attached-object db, the system only goes over the (dense) active set of the attached object
+        bool use_active_set = false;
+
+        /// \brief Execution policy: run the system every N frames (a frame being a call to system_manager::push_tasks)
+        /// \note Systems with the same interval are spread over the frames
+        uint32_t frame_interval = 1;
+
+        /// \brief Execution policy: if not 0, only process a window of the entities each frame, sized to fit that budget
+        /// (from the measured cost of the system). The next window starts where the previous one ended (round-robin).
+        /// \note In fused passes, the window is sized from the cost of the whole pass
+        std::chrono::nanoseconds time_budget { 0 };
+
+        /// \brief Execution policy: if greater than 1, the entities are split in that many stable buckets
+        /// and a single bucket is processed each frame
+        uint32_t bucket_count = 1;
+
+        /// \brief Declare that this system must run after System (if System is in the same system manager)
+        /// \note Must be called in the constructor of the system
+        template<typename System>
+        void run_after()
+        {
+          after.push_back(type_id<System, typename DatabaseConf::system_type>::id());
+        }
+
+        /// \brief Declare that this system must run before System (if System is in the same system manager)
+        /// \note Must be called in the constructor of the system
+        template<typename System>
+        void run_before()
+        {
+          before.push_back(type_id<System, typename DatabaseConf::system_type>::id());
+        }
+
+        /// \brief Data-flow hint: declare that the system reads those attached objects
+        /// (in addition to the ones from the on_entity signature, for instance when accessing them through a concept)
+        /// \note Must be called in the constructor of the system
+        template<typename... AttachedObjects>
+        void reads()
+        {
+          (read_mask.set(id_t<AttachedObjects>::id()), ...);
+        }
+
+        /// \brief Data-flow hint: declare that the system writes those attached objects
+        /// (in addition to the ones from the on_entity signature, for instance when accessing them through a concept)
+        /// \note Must be called in the constructor of the system
+        template<typename... AttachedObjects>
+        void writes()
+        {
+          (write_mask.set(id_t<AttachedObjects>::id()), ...);
+        }
+
       private:
         using entity_data_t = typename entity<DatabaseConf>::data_t;
 
 
+        /// \brief Return whether the system should run on an entity (has the required attached objects and is enabled)
+        bool matches(const entity_data_t& data) const
+        {
+          return mask.match(data.mask) && (data.enabled || include_disabled_entities);
+        }
+
+        /// \brief Return the bucket of an entity (stable for the lifetime of the entity, see bucket_count)
+        static uint32_t get_bucket(const entity_data_t& data, uint32_t bucket_count)
+        {
+          const uint64_t hash = (reinterpret_cast<uintptr_t>(&data) >> 4) * 0x9E3779B97F4A7C15ull;
+          return uint32_t(hash >> 32) % bucket_count;
+        }
+
         /// \brief Run if the entity has the required attached objects
-        void try_run(entity_data_t& data)
+        void try_run(entity_data_t& data, uint32_t worker_index)
         {
-          if (mask.match(data.mask))
-            run(data);
+          if (matches(data))
+            run(data, worker_index);
         }
 
-        virtual void run(entity_data_t& data) = 0;
+        /// \param worker_index The index of the worker running the system (in [0, worker count[, see prepare_worker_states)
+        virtual void run(entity_data_t& data, uint32_t worker_index) = 0;
+        /// \brief Run on a batch of entities that all have the required attached objects
+        virtual void run_batch(std::span<entity_data_t*> entities, uint32_t worker_index) = 0;
         virtual void init_system_for_run() = 0;
 
+        /// \brief Create the per-worker states of the system (called before begin())
+        virtual void prepare_worker_states(uint32_t /*worker_count*/) {}
+        /// \brief Merge the per-worker states of the system (called before end())
+        virtual void merge_worker_states() {}
+
         template<typename AO>
         using id_t = type_id<AO, typename DatabaseConf::attached_object_type>;
         template<typename... Types>
@@ -103,6 +201,30 @@ namespace neam
           mask = helper::make_mask();
         }
 
+        /// \brief Set the read / write masks.
+        /// \note Attached objects taken by const reference are considered read-only, everything else is a write.
+        template<typename... Args>
+        struct access_helper_t
+        {
+          static void set(inline_mask<DatabaseConf>& read, inline_mask<DatabaseConf>& write)
+          {
+            ((std::is_const_v<std::remove_reference_t<Args>> ? read : write).set(id_t<std::remove_cvref_t<Args>>::id()), ...);
+          }
+        };
+        template<typename ArgList>
+        void set_access_masks()
+        {
+          using helper = typename ct::list::extract<ArgList>::template as<access_helper_t>;
+          helper::set(read_mask, write_mask);
+        }
+
+        /// \brief Return whether the two systems cannot run at the same time
+        /// (one of them writes to an attached object the other one reads or writes)
+        bool conflicts_with(const base_system& o) const
+        {
+          return write_mask.intersects(o.write_mask) || write_mask.intersects(o.read_mask) || read_mask.intersects(o.write_mask);
+        }
+
         template<typename AttachedObjectsList>
         void compute_fewest_attached_object_id()
         {
@@ -120,10 +242,41 @@ namespace neam
       private:
         inline_mask<DatabaseConf> mask;
 
+        // attached objects accessed by the system (used to compute the dependencies between systems)
+        inline_mask<DatabaseConf> read_mask;
+        inline_mask<DatabaseConf> write_mask;
+
         const type_t system_id;
         type_t smallest_attached_object_db = ~type_t(0);
 
+        // explicit ordering (system type ids)
+        std::vector<type_t> after;
+        std::vector<type_t> before;
+
+        // whether run_batch should be preferred over run
+        bool has_batch_entry_point = false;
+
+        // state of the execution policies for the current frame
+        bool frame_active = true;
+        bool has_entry_filter = false;
+        uint32_t active_frame_count = 0;
+        uint32_t current_bucket = 0;
+        uint32_t window_cursor = 0;
+        uint32_t window_begin = 0;
+        uint32_t window_size = ~0u;
+        uint32_t window_domain_size = 0;
+
+        // measured cost of the system (for execution modes where entries are processed system by system)
+        run_cost_t cost;
+        uint32_t dispatch_entity_per_task = 0;
+
+        // the worker tasks (for execution modes where entries are processed system by system)
+        parallel_for_t run_loop;
+
+        system_stats_state_t stats;
+
         template<typename DBC, typename SystemClass> friend class system;
+        template<typename DBC, typename... Systems> friend class static_system_pipeline;
         friend class system_manager<DatabaseConf>;
     };
   } // namespace enfield
@@ -0,0 +1,151 @@
+//
+// file : parallel_for.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 09:54:58 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <memory>
+#include <algorithm>
+
+#include <ntools/threading/threading.hpp>
+#include <ntools/tracy.hpp>
+
+namespace neam::enfield
+{
+  /// \brief Process a range of entries with a fixed set of worker tasks.
+  /// Each worker loops, grabbing a chunk at a time, until the range is exhausted.
+  ///
+  /// Two schemes are available:
+  ///  - a single shared cursor (workers grab the next chunk of the range)
+  ///  - per-worker ranges (each worker processes a contiguous part of the range, then steals chunks from the others)
+  /// In both cases entries added during the run (when the count grows) are processed.
+  class parallel_for_t
+  {
+    public:
+      parallel_for_t() = default;
+      parallel_for_t(const parallel_for_t&) = delete;
+      parallel_for_t& operator = (const parallel_for_t&) = delete;
+
+      /// \brief Create the worker tasks
+      /// \param sync The task that will be run once the whole range has been processed
+      /// \param count a function or function-like object with the signature uint32_t(), returning the current number of entries
+      /// \param function a function or function-like object with the signature void(uint32_t begin, uint32_t end, uint32_t worker_index)
+      /// \note Both functions are copied in the worker tasks.
+      /// \warning The parallel_for_t object must outlive the worker tasks, and must not be dispatched again before \e sync has run
+      template<typename CountFunction, typename Function>
+      void dispatch(threading::task_manager& tm, threading::task& sync, uint32_t worker_count, uint32_t chunk_size,
+                    bool use_worker_ranges, CountFunction&& count, Function&& function)
+      {
+        const uint32_t entry_count = count();
+        if (entry_count == 0 || worker_count == 0)
+          return;
+
+        chunk = std::max(chunk_size, 1u);
+
+        if (use_worker_ranges && worker_count > 1)
+        {
+          if (worker_count > range_capacity)
+          {
+            ranges = std::make_unique<worker_range_t[]>(worker_count);
+            range_capacity = worker_count;
+          }
+          range_count = worker_count;
+          const uint32_t entry_per_worker = (entry_count + worker_count - 1) / worker_count;
+          for (uint32_t i = 0; i < worker_count; ++i)
+          {
+            const uint32_t begin = std::min(i * entry_per_worker, entry_count);
+            ranges[i].cursor.store(begin, std::memory_order_relaxed);
+            ranges[i].end = std::min(begin + entry_per_worker, entry_count);
+          }
+          // the shared cursor only handles the entries added during the run
+          cursor.store(entry_count, std::memory_order_release);
+        }
+        else
+        {
+          range_count = 0;
+          cursor.store(0, std::memory_order_release);
+        }
+
+        for (uint32_t i = 0; i < worker_count; ++i)
+        {
+          threading::task_wrapper task = tm.get_task(sync.get_task_group(), [this, i, count, function]()
+          {
+            worker_loop(i, count, function);
+          });
+          sync.add_dependency_to(*task);
+        }
+      }
+
+    private:
+      template<typename CountFunction, typename Function>
+      void worker_loop(uint32_t worker_index, const CountFunction& count, const Function& function)
+      {
+        TRACY_SCOPED_ZONE;
+
+        if (range_count > 0)
+        {
+          // own range first, then steal from the next ones:
+          for (uint32_t i = 0; i < range_count; ++i)
+          {
+            worker_range_t& range = ranges[(worker_index + i) % range_count];
+            while (true)
+            {
+              const uint32_t begin = range.cursor.fetch_add(chunk, std::memory_order_relaxed);
+              if (begin >= range.end)
+                break;
+              function(begin, std::min(begin + chunk, range.end), worker_index);
+            }
+          }
+        }
+
+        while (true)
+        {
+          const uint32_t begin = cursor.fetch_add(chunk, std::memory_order_relaxed);
+          const uint32_t entry_count = count();
+          if (begin >= entry_count)
+            break;
+          function(begin, std::min(begin + chunk, entry_count), worker_index);
+        }
+      }
+
+    private:
+      struct worker_range_t
+      {
+        alignas(64) std::atomic<uint32_t> cursor = 0;
+        uint32_t end = 0;
+      };
+
+      uint32_t chunk = 1;
+
+      std::unique_ptr<worker_range_t[]> ranges;
+      uint32_t range_capacity = 0;
+      uint32_t range_count = 0;
+
+      alignas(64) std::atomic<uint32_t> cursor = 0;
+  };
+} // namespace neam::enfield
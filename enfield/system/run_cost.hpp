@@ -0,0 +1,89 @@
+//
+// file : run_cost.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 09:53:44 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <atomic>
+#include <chrono>
+#include <cstdint>
+
+namespace neam::enfield
+{
+  /// \brief Measured cost of processing an entry (for a system or a pass)
+  /// Chunks are timed as a whole, and the cost is averaged across runs.
+  struct run_cost_t
+  {
+    run_cost_t() = default;
+    /// \note Only the averaged cost is copied
+    run_cost_t(const run_cost_t& o) : cost_per_entry_ns(o.cost_per_entry_ns) {}
+
+    /// \brief Add the measure of a chunk (thread safe)
+    void add_chunk(std::chrono::steady_clock::duration duration, uint32_t entry_count)
+    {
+      time_ns.fetch_add(std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count(), std::memory_order_relaxed);
+      measured_entry_count.fetch_add(entry_count, std::memory_order_relaxed);
+    }
+
+    /// \brief Fold the measures of the last run into the averaged cost
+    /// \warning Not thread safe, must not be called while chunks are being measured
+    void update()
+    {
+      const uint64_t count = measured_entry_count.exchange(0, std::memory_order_relaxed);
+      const uint64_t ns = time_ns.exchange(0, std::memory_order_relaxed);
+      if (count == 0)
+        return;
+
+      const double sample = double(ns) / double(count);
+      if (cost_per_entry_ns <= 0)
+        cost_per_entry_ns = sample;
+      else
+        cost_per_entry_ns = cost_per_entry_ns * (1 - k_sample_weight) + sample * k_sample_weight;
+    }
+
+    /// \brief Return the number of entries that should be processed in \e target_duration
+    /// (or \e default_count if nothing has been measured yet)
+    uint32_t get_entry_count_for(std::chrono::nanoseconds target_duration, uint32_t default_count, uint32_t min_count, uint32_t max_count) const
+    {
+      if (cost_per_entry_ns <= 0)
+        return default_count;
+      const double count = double(target_duration.count()) / cost_per_entry_ns;
+      if (count <= min_count)
+        return min_count;
+      if (count >= max_count)
+        return max_count;
+      return uint32_t(count);
+    }
+
+    static constexpr double k_sample_weight = 0.25;
+
+    double cost_per_entry_ns = 0;
+
+    std::atomic<uint64_t> time_ns = 0;
+    std::atomic<uint64_t> measured_entry_count = 0;
+  };
+} // namespace neam::enfield
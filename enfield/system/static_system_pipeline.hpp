@@ -0,0 +1,292 @@
+//
+// file : static_system_pipeline.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 09:57:46 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <bit>
+#include <tuple>
+#include <utility>
+#include <type_traits>
+
+#include "system.hpp"
+
+namespace neam::enfield
+{
+  namespace internal
+  {
+    /// \brief Remove the duplicates of a list of types (keeps the first occurrence)
+    template<typename List, typename... Types> struct unique_types;
+    template<typename... Uniques>
+    struct unique_types<ct::type_list<Uniques...>>
+    {
+      using type = ct::type_list<Uniques...>;
+    };
+    template<typename... Uniques, typename Type, typename... Types>
+    struct unique_types<ct::type_list<Uniques...>, Type, Types...>
+    {
+      using type = typename std::conditional_t<(std::is_same_v<Type, Uniques> || ...),
+                                               unique_types<ct::type_list<Uniques...>, Types...>,
+                                               unique_types<ct::type_list<Uniques..., Type>, Types...>>::type;
+    };
+
+    template<typename... Types>
+    using unique_types_t = typename unique_types<ct::type_list<>, Types...>::type;
+
+    template<typename... Lists> struct concat_types;
+    template<typename... Types>
+    struct concat_types<ct::type_list<Types...>>
+    {
+      using type = ct::type_list<Types...>;
+    };
+    template<typename... Types0, typename... Types1, typename... Lists>
+    struct concat_types<ct::type_list<Types0...>, ct::type_list<Types1...>, Lists...>
+    {
+      using type = typename concat_types<ct::type_list<Types0..., Types1...>, Lists...>::type;
+    };
+  } // namespace internal
+
+  /// \brief A fixed list of systems, run as a single system:
+  /// For each entity, the attached objects used by the systems are looked-up once, then each matching system is called (in order).
+  /// There is a single virtual call per entity for the whole list, and the on_entity functions can be inlined.
+  ///
+  /// The pipeline can be added to a system_manager like any other system (it holds its own instances of Systems):
+  ///   manager.add_system<static_system_pipeline<db_conf, transform_system, physics_system>>(db);
+  ///
+  /// \note Systems must be classes inheriting from system<DatabaseConf, ...> and must be constructible from the database.
+  /// \note The explicit ordering and the data-flow declarations of the systems apply to the whole pipeline
+  ///       (and the ordering between the systems of the pipeline is the order of the template parameters).
+  /// \note system_manager::get_system / has_system don't see the systems of the pipeline, use get_system<I>() on the pipeline instead
+  /// \note The systems are called entity by entity: their on_entities functions are not used
+  /// \note The frame_interval and bucket_count of the systems are applied per system, relative to the frames the pipeline runs in
+  ///       (so they combine with the policies of the pipeline). The time_budget of the systems is not supported:
+  ///       the window of entities is chosen for the whole pipeline.
+  /// \note Systems with use_active_set skip the sleeping entities. The pipeline only iterates over the active sets
+  ///       when all its systems have use_active_set.
+  template<typename DatabaseConf, typename... Systems>
+  class static_system_pipeline final : public base_system<DatabaseConf>
+  {
+    private:
+      static_assert(sizeof...(Systems) > 0, "static_system_pipeline: at least one system is required");
+
+      using entity_data_t = typename entity<DatabaseConf>::data_t;
+      using base_system_t = base_system<DatabaseConf>;
+
+      // all the attached objects used by the systems (without duplicates)
+      using attached_object_list_t = typename ct::list::extract
+      <
+        typename internal::concat_types<typename Systems::template attached_object_list_t<Systems>...>::type
+      >::template as<internal::unique_types_t>;
+
+      template<typename List> struct lookup_helper_t;
+      template<typename... AttachedObjects>
+      struct lookup_helper_t<ct::type_list<AttachedObjects...>>
+      {
+        using type = std::tuple<AttachedObjects*...>;
+
+        static void fetch(type& lookups, entity_data_t& data)
+        {
+          ((std::get<AttachedObjects*>(lookups) = data.template has<AttachedObjects>() ? data.template slow_get<AttachedObjects>() : nullptr), ...);
+        }
+      };
+      using lookup_helper = lookup_helper_t<attached_object_list_t>;
+      using lookups_t = typename lookup_helper::type;
+
+      template<typename System, typename List> struct call_helper_t;
+      template<typename System, typename... AttachedObjects>
+      struct call_helper_t<System, ct::type_list<AttachedObjects...>>
+      {
+        static void call(System& sys, uint32_t worker_index, lookups_t& lookups)
+        {
+          System::template call_on_entity<AttachedObjects...>(sys, worker_index, *std::get<AttachedObjects*>(lookups)...);
+        }
+      };
+      template<typename System>
+      using call_helper = call_helper_t<System, typename System::template attached_object_list_t<System>>;
+
+    public:
+      static_system_pipeline(database<DatabaseConf>& _db)
+        : base_system_t(_db, type_id<static_system_pipeline, typename DatabaseConf::system_type>::id()),
+          systems(((void)std::type_identity<Systems>{}, _db)...)
+      {
+        // the pipeline requires what all the systems require, and accesses / is ordered like all of them
+        this->mask = static_cast<base_system_t&>(std::get<0>(systems)).mask;
+        std::apply([this](Systems& ... sys)
+        {
+          (merge_system(static_cast<base_system_t&>(sys)), ...);
+          this->use_active_set = (static_cast<base_system_t&>(sys).use_active_set && ...);
+        }, systems);
+      }
+
+      virtual std::string get_system_name() const override
+      {
+        return neam::demangle<static_system_pipeline>();
+      }
+
+      void begin() final
+      {
+        for_each_active_system([](base_system_t& sys) { sys.begin(); });
+      }
+
+      void end() final
+      {
+        for_each_active_system([](base_system_t& sys) { sys.end(); });
+      }
+
+      /// \brief Return the Ith system of the pipeline
+      template<size_t Index>
+      auto& get_system() { return std::get<Index>(systems); }
+
+    private:
+      void merge_system(base_system_t& sys)
+      {
+        for (size_t j = 0; j < inline_mask<DatabaseConf>::entry_count; ++j)
+        {
+          this->mask.mask[j] &= sys.mask.mask[j];
+          this->read_mask.mask[j] |= sys.read_mask.mask[j];
+          this->write_mask.mask[j] |= sys.write_mask.mask[j];
+        }
+        check::debug::n_assert(sys.time_budget.count() <= 0, "static_system_pipeline: {}: the time budget of the systems of a pipeline is not supported",
+                               sys.get_system_name());
+        this->include_disabled_entities = this->include_disabled_entities || sys.include_disabled_entities;
+        this->after.insert(this->after.end(), sys.after.begin(), sys.after.end());
+        this->before.insert(this->before.end(), sys.before.begin(), sys.before.end());
+      }
+
+      void run(entity_data_t& data, uint32_t worker_index) final override
+      {
+        lookups_t lookups;
+        lookup_helper::fetch(lookups, data);
+        uint64_t mask_version = data.mask_version;
+
+        run_systems(data, worker_index, lookups, mask_version, std::index_sequence_for<Systems...>{});
+      }
+
+      void run_batch(std::span<entity_data_t*> entities, uint32_t worker_index) final override
+      {
+        for (entity_data_t* it : entities)
+          run(*it, worker_index);
+      }
+
+      void prepare_worker_states(uint32_t worker_count) final override
+      {
+        for_each_active_system([worker_count](base_system_t& sys) { sys.prepare_worker_states(worker_count); });
+      }
+
+      void merge_worker_states() final override
+      {
+        for_each_active_system([](base_system_t& sys) { sys.merge_worker_states(); });
+      }
+
+      /// \brief Call func(base_system_t&) for the systems that run this frame (see update_frame_policies)
+      template<typename Func>
+      void for_each_active_system(Func&& func)
+      {
+        std::apply([&func](Systems& ... sys)
+        {
+          ([&func](base_system_t& it)
+          {
+            if (it.frame_active)
+              func(it);
+          } (static_cast<base_system_t&>(sys)), ...);
+        }, systems);
+      }
+
+      /// \brief Update the frame interval / bucket state of a system (like system_manager does for the pipeline itself)
+      /// The frames are the frames the pipeline runs in
+      void update_frame_policies(base_system_t& sys)
+      {
+        sys.frame_active = sys.frame_interval <= 1 || (this->active_frame_count + sys.system_id) % sys.frame_interval == 0;
+        if (sys.frame_active)
+        {
+          sys.current_bucket = sys.bucket_count > 1 ? sys.active_frame_count % sys.bucket_count : 0;
+          ++sys.active_frame_count;
+        }
+      }
+
+      template<size_t... Indices>
+      void run_systems(entity_data_t& data, uint32_t worker_index, lookups_t& lookups, uint64_t& mask_version, std::index_sequence<Indices...>)
+      {
+        (run_system(std::get<Indices>(systems), data, worker_index, lookups, mask_version), ...);
+      }
+
+      template<typename System>
+      void run_system(System& sys, entity_data_t& data, uint32_t worker_index, lookups_t& lookups, uint64_t& mask_version)
+      {
+        // a previous system changed the attached objects of the entity:
+        if (mask_version != data.mask_version)
+        {
+          lookup_helper::fetch(lookups, data);
+          mask_version = data.mask_version;
+        }
+
+        base_system_t& base = static_cast<base_system_t&>(sys);
+        // the pipeline is selected as a whole, so the execution policies have to be applied per system
+        if (!base.frame_active)
+          return;
+        if (base.use_active_set && data.sleeping.load(std::memory_order_relaxed))
+          return;
+        if (base.bucket_count > 1 && base_system_t::get_bucket(data, base.bucket_count) != base.current_bucket)
+          return;
+
+        if (base.matches(data))
+          call_helper<System>::call(sys, worker_index, lookups);
+      }
+
+      void init_system_for_run() final override
+      {
+        // called once per frame the pipeline runs in, before everything else
+        std::apply([this](Systems& ... sys) { (update_frame_policies(static_cast<base_system_t&>(sys)), ...); }, systems);
+        for_each_active_system([](base_system_t& sys) { sys.init_system_for_run(); });
+
+        // iterate over the smallest list of the attached objects required by all the systems:
+        this->smallest_attached_object_db = ~type_t(0);
+        if constexpr (DatabaseConf::use_attached_object_db)
+        {
+          size_t min_count = ~size_t(0);
+          for (size_t j = 0; j < inline_mask<DatabaseConf>::entry_count; ++j)
+          {
+            for (uint64_t bits = this->mask.mask[j]; bits != 0; bits &= bits - 1)
+            {
+              const type_t id = j * 64 + std::countr_zero(bits);
+              if (this->db.get_attached_object_count(id) < min_count)
+              {
+                min_count = this->db.get_attached_object_count(id);
+                this->smallest_attached_object_db = id;
+              }
+            }
+          }
+        }
+        // nothing is required by all the systems: the entity list has to be used
+        if (this->smallest_attached_object_db == ~type_t(0))
+          this->should_use_attached_object_db = false;
+      }
+
+    private:
+      std::tuple<Systems...> systems;
+  };
+} // namespace neam::enfield
@@ -29,6 +29,10 @@
 
 #pragma once
 
+#include <span>
+#include <memory>
+#include <vector>
+#include <algorithm>
 #include <type_traits>
 
 #include "base_system.hpp"
@@ -47,6 +51,17 @@ namespace neam
     ///  void begin();
     ///  void on_entity(... /* put here the attached objects the entity should have */ ...);
     ///  void end();
+    /// And optionally:
+    ///  void on_entities(std::span<entity_data_t*> entities);
+    /// If present, on_entities is called (instead of on_entity) with all the matching entities of a chunk
+    /// (on_entity still defines the attached objects the entities should have). Use get<AttachedObject>(data) to access them.
+    ///
+    /// Systems that accumulate results can declare a per-worker state:
+    ///  struct worker_state { ... }; // must be default constructible
+    ///  void on_entity(worker_state& state, ... /* attached objects */ ...);
+    ///  void merge(worker_state& state);
+    /// A state is constructed per worker before begin(), each worker only uses its own state,
+    /// and merge() is called with every state before end(). (on_entities then takes the state as its first argument)
     ///
     /// Depending on the threading model, the on_entity function may be called at the same time on different entities
     /// on multiple threads, but an entity can't have more than one system doing stuff with it at a time
@@ -71,8 +86,12 @@ namespace neam
           : base_system<DatabaseConf>(_db, type_id<SystemClass, typename DatabaseConf::system_type>::id())
         {
           // setup the mask
-          using list = ct::list::for_each<typename ct::function_traits<decltype(&SystemClass::on_entity)>::arg_list, rm_rcv>;
-          this->template set_mask<list>();
+          this->template set_mask<attached_object_list_t<>>();
+
+          // setup the read / write masks (const references are reads, everything else is a write)
+          this->template set_access_masks<on_entity_arg_list_t<>>();
+
+          this->has_batch_entry_point = has_on_entities();
         }
 
         virtual ~system() = default;
@@ -92,32 +111,150 @@ namespace neam
         template<typename AttachedObject, typename... DataProvider>
         void add(DataProvider* ...providers);
 
-      private:
         using entity_data_t = typename entity<DatabaseConf>::data_t;
+
+        /// \brief Return an attached object of an entity matching the system
+        /// \note Only usable in SystemClass::on_entities(), with the attached objects of the on_entity signature
+        template<typename AttachedObject>
+        AttachedObject& get(entity_data_t& data)
+        {
+          return *this->db.template entity_get<AttachedObject>(data);
+        }
+
+      private:
         template<typename AO>
         using id_t = type_id<AO, typename DatabaseConf::attached_object_type>;
 
         template<typename... AttachedObjects>
         struct run_helper_t
         {
-          static auto run(SystemClass& self, entity_data_t& data)
+          static auto run(SystemClass& self, entity_data_t& data, uint32_t worker_index)
           {
-            self.on_entity(*self.db.template entity_get<AttachedObjects>(data)...);
+            call_on_entity(self, worker_index, *self.db.template entity_get<AttachedObjects>(data)...);
           }
         };
 
-        void run(entity_data_t& data) final override
+        void run(entity_data_t& data, uint32_t worker_index) final override
         {
-          using list = ct::list::for_each<typename ct::function_traits<decltype(&SystemClass::on_entity)>::arg_list, rm_rcv>;
-          using helper = typename ct::list::extract<list>::template as<run_helper_t>;
-          helper::run(*static_cast<SystemClass*>(this), data);
+          using helper = typename ct::list::extract<attached_object_list_t<>>::template as<run_helper_t>;
+          helper::run(*static_cast<SystemClass*>(this), data, worker_index);
+        }
+
+        static constexpr bool has_on_entities()
+        {
+          if constexpr (has_worker_state())
+            return requires(SystemClass& self, worker_state_t<>& state, std::span<entity_data_t*> entities) { self.on_entities(state, entities); };
+          else
+            return requires(SystemClass& self, std::span<entity_data_t*> entities) { self.on_entities(entities); };
+        }
+
+        void run_batch(std::span<entity_data_t*> entities, uint32_t worker_index) final override
+        {
+          if constexpr (has_on_entities() && has_worker_state())
+          {
+            static_cast<SystemClass*>(this)->on_entities(get_worker_state(worker_index), entities);
+          }
+          else if constexpr (has_on_entities())
+          {
+            static_cast<SystemClass*>(this)->on_entities(entities);
+          }
+          else
+          {
+            for (entity_data_t* it : entities)
+              run(*it, worker_index);
+          }
         }
 
         void init_system_for_run() final override
         {
-          using list = ct::list::for_each<typename ct::function_traits<decltype(&SystemClass::on_entity)>::arg_list, rm_rcv>;
-          this->template compute_fewest_attached_object_id<list>();
+          this->template compute_fewest_attached_object_id<attached_object_list_t<>>();
+        }
+
+        /// \brief Whether SystemClass declares a worker_state
+        template<typename Self = SystemClass>
+        static constexpr bool has_worker_state()
+        {
+          return requires { typename Self::worker_state; };
+        }
+
+        template<typename Self = SystemClass>
+        using worker_state_t = typename Self::worker_state;
+
+        // one state per cache-line, so that workers don't share them
+        template<typename State>
+        struct alignas(64) worker_state_slot_t
+        {
+          State state;
+        };
+
+        template<typename List, bool DropFirst> struct arg_list_helper { using type = List; };
+        template<typename First, typename... Args>
+        struct arg_list_helper<ct::type_list<First, Args...>, true>
+        {
+          static_assert(std::is_same_v<rm_rcv<First>, worker_state_t<>>, "on_entity must take the worker_state as its first argument");
+          using type = ct::type_list<Args...>;
+        };
+
+        /// \brief The arguments of on_entity that are attached objects (without the worker state)
+        template<typename Self = SystemClass>
+        using on_entity_arg_list_t = typename arg_list_helper<typename ct::function_traits<decltype(&Self::on_entity)>::arg_list, has_worker_state<Self>()>::type;
+
+        /// \brief The attached objects on_entity takes (without cv / references)
+        /// \note Template so that SystemClass is complete when it gets instantiated
+        template<typename Self = SystemClass>
+        using attached_object_list_t = ct::list::for_each<on_entity_arg_list_t<Self>, rm_rcv>;
+
+        template<typename Self = SystemClass>
+        std::vector<worker_state_slot_t<worker_state_t<Self>>>& get_worker_state_slots()
+        {
+          return *static_cast<std::vector<worker_state_slot_t<worker_state_t<Self>>>*>(worker_states.get());
         }
+
+        template<typename Self = SystemClass>
+        worker_state_t<Self>& get_worker_state(uint32_t worker_index)
+        {
+          return get_worker_state_slots<Self>()[worker_index].state;
+        }
+
+        void prepare_worker_states(uint32_t worker_count) final override
+        {
+          if constexpr (has_worker_state())
+          {
+            using slots_t = std::vector<worker_state_slot_t<worker_state_t<>>>;
+            if (!worker_states)
+              worker_states = std::make_shared<slots_t>();
+
+            // states are always fresh for a run
+            slots_t& slots = get_worker_state_slots();
+            slots.clear();
+            slots.resize(std::max(1u, worker_count));
+          }
+        }
+
+        void merge_worker_states() final override
+        {
+          if constexpr (has_worker_state())
+          {
+            for (auto& it : get_worker_state_slots())
+              static_cast<SystemClass*>(this)->merge(it.state);
+          }
+        }
+
+        /// \brief Call on_entity (which may be private, as long as this class is a friend of SystemClass)
+        template<typename... AttachedObjects>
+        static void call_on_entity(SystemClass& self, uint32_t worker_index, AttachedObjects& ... objs)
+        {
+          if constexpr (has_worker_state())
+            self.on_entity(self.get_worker_state(worker_index), objs...);
+          else
+            self.on_entity(objs...);
+        }
+
+      private:
+        // the per-worker states (type-erased, as SystemClass isn't complete here)
+        std::shared_ptr<void> worker_states;
+
+        template<typename DBC, typename... Systems> friend class static_system_pipeline;
     };
   } // namespace enfield
 } // namespace neam
@@ -29,10 +29,18 @@
 
 #pragma once
 
+#include <span>
 #include <vector>
+#include <memory>
 #include <atomic>
+#include <chrono>
+#include <algorithm>
+#include <bit>
+#include <set>
+#include <thread>
 
 #include "base_system.hpp"
+#include "parallel_for.hpp"
 #include "../entity.hpp"
 #include "../database.hpp"
 
@@ -42,6 +50,44 @@
 
 namespace neam::enfield
 {
+  /// \brief How a system manager dispatches its systems
+  /// \note In every mode, the explicit ordering of systems (run_after / run_before) is respected
+  enum class system_execution_mode
+  {
+    /// \brief Entities in a chunk will go through all systems without any sync point
+    /// This is the lightest option, but systems must not depend on other entities
+    per_entity,
+
+    /// \brief All entities will go through the systems that have no dependency left, then a sync point, then the next ones, ...
+    /// Systems that are neither ordered nor conflicting share the same pass (there's one sync point per level of the schedule)
+    sequential,
+
+    /// \brief One system at a time: all entities will go through one system, then a sync point, then the next system, ...
+    /// Systems are never fused, even when they don't conflict, so systems that communicate through begin() / end()
+    /// or external state always see the complete results of the previous ones
+    strict_sequential,
+
+    /// \brief Like sequential, but there's no global sync point: a system starts as soon as the systems it depends on are done
+    parallel,
+
+    /// \brief Like sequential, but the sync points are per chunk of entities: the systems of a level can process a chunk
+    /// as soon as the previous level has processed that chunk and its neighbour chunks (see base_system::pipeline_neighbour_chunks)
+    /// \note begin() is called on every system before the pipeline starts, end() once every chunk has gone through every level
+    /// \note Always iterate over the entity list (should_use_attached_object_db is not honoured)
+    /// \note Requires the entity db (falls back to sequential otherwise)
+    pipelined,
+  };
+
+  /// \brief Holds and run a set of systems
+  ///
+  /// The systems are run following a schedule computed from:
+  ///  - the explicit ordering (base_system::run_after / base_system::run_before)
+  ///  - the conflicts between systems: attached objects taken by const reference in on_entity are reads,
+  ///    everything else is a write (see also base_system::reads / base_system::writes for data-flow hints).
+  ///    Two systems conflict if one of them writes to something the other reads or writes.
+  ///    Conflicting systems that are not explicitly ordered run in the order they were added.
+  /// \note Accesses performed through concept providers or by other means (get_unsafe, ...) are not visible
+  ///       and must be declared with the data-flow hints or the explicit ordering.
   template<typename DatabaseConf>
   class system_manager
   {
@@ -50,6 +96,47 @@ namespace neam::enfield
       using entity_t = entity<DatabaseConf>;
       using entity_data_t = typename entity_t::data_t;
 
+      static constexpr uint32_t k_invalid_index = ~uint32_t(0);
+
+      // bounds (and default value) of the number of entities a task will process
+      static constexpr uint32_t k_default_entity_per_task = 1024;
+      static constexpr uint32_t k_min_entity_per_task = 16;
+      static constexpr uint32_t k_max_entity_per_task = 65536;
+
+      // over that number of systems in a single pass, the match cache is not used
+      static constexpr uint32_t k_max_cached_system_count = 64;
+
+      /// \brief The systems that matched an entity, for a fused pass (bit N is set if the Nth system of the pass matched)
+      /// Valid as long as the entity is the same and its mask_version didn't change
+      struct match_cache_entry_t
+      {
+        const entity_data_t* entity = nullptr;
+        uint64_t mask_version = 0;
+        uint64_t matching_systems = 0;
+      };
+
+      /// \brief State of a pass running a list of systems over the same entities
+      struct fused_pass_t
+      {
+        std::vector<match_cache_entry_t> match_cache;
+
+        // the attached-object lists to iterate over (if empty, the entity list is used)
+        std::vector<type_t> domain;
+        // index of the first entry of each list of the domain (+ the total entry count)
+        std::vector<uint32_t> domain_offsets;
+        // entities that have one of those attached objects have already been processed via a previous list of the domain
+        std::vector<inline_mask<DatabaseConf>> skip_masks;
+
+        // measured cost of the pass
+        run_cost_t cost;
+        uint32_t entity_per_task = k_default_entity_per_task;
+
+        // if true, chunks are processed system by system (some systems have a batch entry point)
+        bool has_batch_system = false;
+
+        parallel_for_t run_loop;
+      };
+
     public:
       system_manager() : systems() {}
       system_manager(const system_manager&) = delete;
@@ -62,6 +149,20 @@ namespace neam::enfield
       System& add_system(Args&& ... args)
       {
         systems.emplace_back(new System(std::forward<Args>(args)...));
+        schedule_dirty = true;
+
+        const type_t id = systems.back()->system_id;
+        if (system_lookup.size() <= id)
+          system_lookup.resize(id + 1, k_invalid_index);
+        if (system_lookup[id] == k_invalid_index)
+          system_lookup[id] = systems.size() - 1;
+
+        // lazy attached objects (like lazy concepts) the system iterates or accesses have to exist from now on
+        base_system<DatabaseConf>& sys = *systems.back();
+        sys.db.materialize(sys.mask);
+        sys.db.materialize(sys.read_mask);
+        sys.db.materialize(sys.write_mask);
+
         return static_cast<System&>(*systems.back());
       }
       /// \brief Remove a system from the list
@@ -69,122 +170,447 @@ namespace neam::enfield
       template<typename System>
       void remove_system()
       {
-        const type_t id = type_id<System, typename DatabaseConf::system_type>::id;
+        const type_t id = type_id<System, typename DatabaseConf::system_type>::id();
         systems.erase(std::remove_if(systems.begin(), systems.end(), [id](auto & sys)
         {
           return (sys->system_id == id);
         }), systems.end());
+        schedule_dirty = true;
+
+        // rebuild the lookup table:
+        std::fill(system_lookup.begin(), system_lookup.end(), k_invalid_index);
+        for (uint32_t i = 0; i < systems.size(); ++i)
+        {
+          if (system_lookup[systems[i]->system_id] == k_invalid_index)
+            system_lookup[systems[i]->system_id] = i;
+        }
       }
 
       /// \brief Retrieve a system from the list
+      /// \note If the same system has been added multiple times, the first one is returned
       template<typename System>
       System& get_system()
       {
-        const type_t id = type_id<System, typename DatabaseConf::system_type>::id;
-        for (auto& sys : systems)
-        {
-          if (sys->system_id == id)
-            return *static_cast<System*>(sys);
-        }
-        check::debug::n_assert(false, "Could not find system with type id {}", id);
+        const type_t id = type_id<System, typename DatabaseConf::system_type>::id();
+        check::debug::n_assert(has_system<System>(), "Could not find system with type id {}", id);
+        return static_cast<System&>(*systems[system_lookup[id]]);
       }
 
       /// \brief Check if a system is in the list
       template<typename System>
       bool has_system() const
       {
-        const type_t id = type_id<System, typename DatabaseConf::system_type>::id;
-        for (const auto& sys : systems)
-        {
-          if (sys->system_id == id)
-            return true;
-        }
-        return false;
+        const type_t id = type_id<System, typename DatabaseConf::system_type>::id();
+        return id < system_lookup.size() && system_lookup[id] != k_invalid_index;
+      }
+
+      /// \brief Set the duration the tasks should last
+      /// The number of entities a task processes is adapted (from the measured cost of the systems) to match that duration.
+      /// Smaller values balance the load better, larger values reduce the overhead of the task system.
+      /// \see base_system::entity_per_task
+      void set_target_task_duration(std::chrono::nanoseconds duration)
+      {
+        target_task_duration = duration;
+      }
+
+      std::chrono::nanoseconds get_target_task_duration() const
+      {
+        return target_task_duration;
+      }
+
+      /// \brief Set the maximum number of tasks that process the entities of a pass concurrently
+      /// \see base_system::max_task_count
+      void set_max_task_count(uint32_t count)
+      {
+        check::debug::n_assert(count > 0, "system_manager::set_max_task_count: count must be greater than 0");
+        max_task_count = count;
+      }
+
+      uint32_t get_max_task_count() const
+      {
+        return max_task_count;
+      }
+
+      /// \brief If true, each worker task processes a contiguous range of entities, then steals chunks from the other workers
+      /// (better locality, but the chunks of an entity range are always processed by the same worker)
+      /// If false (the default), workers grab the next chunk of the whole range.
+      void set_use_worker_ranges(bool use)
+      {
+        use_worker_ranges = use;
+      }
+
+      /// \brief Return the statistics of the systems (in the order they were added), computed over their last runs
+      /// \warning Must not be called while the systems are running
+      std::vector<system_stats_t> get_stats() const
+      {
+        std::vector<system_stats_t> ret;
+        ret.reserve(systems.size());
+        for (const auto& it : systems)
+          ret.push_back(it->stats.compute(it->get_system_name()));
+        return ret;
       }
 
       /// \brief Push all task from all systems
-      /// \param entity_per_task The number of entities that each task will grab
       /// \param sync_exec If false, entities in a chunk will go through all systems without any sync point
       ///                  If true, all entities will go through one system, then a sync point, then the next system, ...
       /// \return The final task (for synchronisation purpose)
       /// \note With sync_exec to false is the lightest option.
       /// \note All systems will belong to the same task group.
-      ///       If you want to have parallel execution of systems, create multiple system managers
+      ///       To fuse systems that don't conflict, or run them in parallel, use the system_execution_mode overload
       ///
       /// \warning creating or destroying entities during the execution of a system is a very very bad idea
       threading::task& push_tasks(database_t& db, threading::task_manager& tm, neam::id_t group_name,
                                   bool sync_exec = false)
+      {
+        return push_tasks(db, tm, group_name, sync_exec ? system_execution_mode::strict_sequential : system_execution_mode::per_entity);
+      }
+
+      /// \brief Push all task from all systems
+      /// \return The final task (for synchronisation purpose)
+      /// \note All systems will belong to the same task group.
+      /// \see system_execution_mode
+      ///
+      /// \warning creating or destroying entities during the execution of a system is a very very bad idea
+      threading::task& push_tasks(database_t& db, threading::task_manager& tm, neam::id_t group_name,
+                                  system_execution_mode mode)
       {
         TRACY_SCOPED_ZONE;
         const threading::group_t group = tm.get_group_id(group_name);
 
+        compute_schedule();
+
+        worker_slot_count = max_task_count;
+        for (const auto& it : systems)
+        {
+          worker_slot_count = std::max(worker_slot_count, it->max_task_count);
+          update_frame_policies(*it);
+        }
+        ++frame_index;
+
         threading::task_wrapper final_task_wr;
 
         // we only require the heavy/slow option when:
-        //  - we have more than one system
+        //  - we have more than one pass
         //  - we are required to have sync points
-        if (sync_exec && systems.size() > 1)
+        if (mode == system_execution_mode::parallel && levels.size() > 1)
         {
           final_task_wr = tm.get_task(group, []() {});
 
-          sync_point(true, db, tm, *final_task_wr);
+          push_parallel_tasks(db, tm, *final_task_wr);
         }
-        else // not sync_exec
+        else if (mode == system_execution_mode::pipelined && levels.size() > 1 && DatabaseConf::use_entity_db)
         {
           final_task_wr = tm.get_task(group, [this]()
           {
             // call end() on all the systems:
-            for (auto& it : systems)
-              it->end();
+            for (const uint32_t it : order)
+              end_system(*systems[it]);
           });
-          index.store(0, std::memory_order_relaxed);
 
+          // call begin() on all the systems:
+          for (const uint32_t it : order)
+            begin_system(*systems[it]);
+
+          dispatch_pipeline(db, tm, *final_task_wr);
+        }
+        else if ((mode == system_execution_mode::sequential || mode == system_execution_mode::pipelined) && levels.size() > 1)
+        {
+          final_task_wr = tm.get_task(group, []() {});
+
+          sync_levels = &levels;
+          sync_point(true, db, tm, *final_task_wr);
+        }
+        else if (mode == system_execution_mode::strict_sequential && systems.size() > 1)
+        {
+          final_task_wr = tm.get_task(group, []() {});
+
+          sync_levels = &single_system_levels;
+          sync_point(true, db, tm, *final_task_wr);
+        }
+        else // per_entity (or no sync point is needed)
+        {
+          final_task_wr = tm.get_task(group, [this]()
+          {
+            // call end() on all the systems:
+            for (const uint32_t it : order)
+              end_system(*systems[it]);
+          });
 
           // call begin() on all the systems:
-          for (auto& it : systems)
+          for (const uint32_t it : order)
+            begin_system(*systems[it]);
+
+          dispatch_systems(order, *fused_passes.back(), db, tm, *final_task_wr);
+        }
+
+        return *final_task_wr;
+      }
+
+    private:
+      /// \brief Compute the schedule of the systems:
+      ///  - a topological order of the systems (explicit ordering first, then insertion order)
+      ///  - for each system, the systems that must have completed before it can start
+      ///  - the levels of the schedule (sets of systems that can run in the same pass)
+      void compute_schedule()
+      {
+        if (!schedule_dirty)
+          return;
+        TRACY_SCOPED_ZONE;
+        schedule_dirty = false;
+
+        const uint32_t count = systems.size();
+
+        // explicit ordering:
+        std::vector<std::vector<uint32_t>> successors(count);
+        std::vector<uint32_t> in_degree(count, 0);
+        const auto add_edge = [&](uint32_t from, uint32_t to)
+        {
+          successors[from].push_back(to);
+          ++in_degree[to];
+        };
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          for (uint32_t j = 0; j < count; ++j)
           {
-            it->init_system_for_run();
-            it->begin();
+            if (i == j) continue;
+            for (const type_t it : systems[i]->after)
+            {
+              if (systems[j]->system_id == it)
+                add_edge(j, i);
+            }
+            for (const type_t it : systems[i]->before)
+            {
+              if (systems[j]->system_id == it)
+                add_edge(i, j);
+            }
           }
+        }
 
-          // compute the number of task to dispatch, but limit that to a max number
-          // to avoid saturating the task system
-          // const uint32_t entity_count = db.get_entity_count();
-          // uint32_t dispatch_count = entity_count / entity_per_task;
-          // if (dispatch_count > max_task_count)
-            // dispatch_count = max_task_count;
-          uint32_t dispatch_count = max_task_count;
-          for (uint32_t i = 0; i < dispatch_count; ++i)
+        // topological sort (Kahn's algorithm, the ready system that was added first goes first):
+        order.clear();
+        order.reserve(count);
+        std::set<uint32_t> ready;
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          if (in_degree[i] == 0)
+            ready.insert(i);
+        }
+        while (!ready.empty())
+        {
+          const uint32_t it = *ready.begin();
+          ready.erase(ready.begin());
+          order.push_back(it);
+          for (const uint32_t next : successors[it])
           {
-            threading::task_wrapper task = tm.get_task(group, [this, &db, &tm, &final_task = *final_task_wr]() { run_all_systems(db, tm, final_task); });
-            final_task_wr->add_dependency_to(*task);
+            if (--in_degree[next] == 0)
+              ready.insert(next);
           }
         }
+        if (order.size() != count)
+        {
+          check::debug::n_assert(false, "system_manager: there is a cycle in the system ordering, falling back to insertion order");
+          order.resize(count);
+          for (uint32_t i = 0; i < count; ++i)
+            order[i] = i;
+          for (auto& it : successors)
+            it.clear();
+        }
 
-        return *final_task_wr;
+        std::vector<uint32_t> position(count);
+        for (uint32_t i = 0; i < count; ++i)
+          position[order[i]] = i;
+
+        // dependencies: explicit ordering + conflicts (conflicting systems are run in the topological order)
+        dependencies.clear();
+        dependencies.resize(count);
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          for (const uint32_t next : successors[i])
+            dependencies[next].push_back(i);
+        }
+        for (uint32_t i = 0; i < count; ++i)
+        {
+          for (uint32_t j = 0; j < i; ++j)
+          {
+            const uint32_t first = order[j];
+            const uint32_t second = order[i];
+            if (systems[second]->conflicts_with(*systems[first])
+                && std::find(dependencies[second].begin(), dependencies[second].end(), first) == dependencies[second].end())
+            {
+              dependencies[second].push_back(first);
+            }
+          }
+        }
+
+        // levels: (longest path from the roots, so the number of sync points is minimal)
+        std::vector<uint32_t> system_level(count, 0);
+        uint32_t level_count = 0;
+        for (const uint32_t it : order)
+        {
+          for (const uint32_t dep : dependencies[it])
+            system_level[it] = std::max(system_level[it], system_level[dep] + 1);
+          level_count = std::max(level_count, system_level[it] + 1);
+        }
+        levels.clear();
+        levels.resize(level_count);
+        for (const uint32_t it : order)
+          levels[system_level[it]].push_back(it);
+
+        single_system_levels.clear();
+        single_system_levels.reserve(count);
+        for (const uint32_t it : order)
+          single_system_levels.push_back({ it });
+
+        // one fused pass per level, and one for the full order (system indices have changed, so no cache entry is valid anymore)
+        fused_passes.clear();
+        for (uint32_t i = 0; i < levels.size() + 1; ++i)
+          fused_passes.push_back(std::make_unique<fused_pass_t>());
       }
 
-    private:
+      /// \brief Update the per-frame state of the execution policies of a system (frame interval, buckets)
+      void update_frame_policies(base_system<DatabaseConf>& system)
+      {
+        // spread the systems with the same interval over the frames:
+        system.frame_active = system.frame_interval <= 1 || (frame_index + system.system_id) % system.frame_interval == 0;
+        if (system.frame_active)
+        {
+          system.current_bucket = system.bucket_count > 1 ? system.active_frame_count % system.bucket_count : 0;
+          ++system.active_frame_count;
+        }
+        system.window_size = ~0u;
+        system.has_entry_filter = !system.frame_active || system.bucket_count > 1 || system.use_active_set;
+      }
+
+      /// \brief Compute the window of entries a system will process this frame (see base_system::time_budget)
+      void update_window(base_system<DatabaseConf>& system, uint32_t domain_size, const run_cost_t& cost)
+      {
+        system.window_domain_size = domain_size;
+        if (system.time_budget.count() <= 0 || domain_size == 0)
+        {
+          system.window_begin = 0;
+          system.window_size = ~0u;
+          return;
+        }
+
+        system.window_size = cost.get_entry_count_for(system.time_budget, k_default_entity_per_task, 1, domain_size);
+        system.window_begin = system.window_cursor % domain_size;
+        system.window_cursor = (system.window_begin + system.window_size) % domain_size;
+        system.has_entry_filter = system.has_entry_filter || system.window_size < domain_size;
+      }
+
+      /// \brief Return the entry index of the i-th entry of the window of a system
+      static uint32_t get_window_entry_index(const base_system<DatabaseConf>& system, uint32_t i)
+      {
+        if (system.window_size >= system.window_domain_size)
+          return i;
+        return (system.window_begin + i) % system.window_domain_size;
+      }
+
+      /// \brief Return whether a system should process an entry this frame (see the execution policies of base_system)
+      static bool is_selected(const base_system<DatabaseConf>& system, uint32_t entry_index, const entity_data_t& data)
+      {
+        if (!system.frame_active)
+          return false;
+        if (system.use_active_set && data.sleeping.load(std::memory_order_relaxed))
+          return false;
+        if (system.window_size < system.window_domain_size)
+        {
+          const uint32_t offset = entry_index >= system.window_begin ? entry_index - system.window_begin
+                                  : entry_index + system.window_domain_size - system.window_begin;
+          if (offset >= system.window_size)
+            return false;
+        }
+        if (system.bucket_count > 1 && base_system<DatabaseConf>::get_bucket(data, system.bucket_count) != system.current_bucket)
+          return false;
+        return true;
+      }
+
+      /// \brief Start the run of a system
+      void begin_system(base_system<DatabaseConf>& system)
+      {
+        if (!system.frame_active)
+          return;
+        system.init_system_for_run();
+        system.stats.prepare(worker_slot_count);
+        system.prepare_worker_states(worker_slot_count);
+        system.stats.shared_run_time = false;
+        system.stats.start_time = std::chrono::steady_clock::now();
+        system.begin();
+      }
+
+      /// \brief End the run of a system and collect its statistics
+      void end_system(base_system<DatabaseConf>& system)
+      {
+        if (!system.frame_active)
+          return;
+        system.merge_worker_states();
+        system.end();
+        [[maybe_unused]] const system_run_stats_t& run = system.stats.finish_run(std::chrono::steady_clock::now());
+
+        if (system.stats.plot_name_run_time.empty())
+        {
+          system.stats.plot_name_run_time = system.get_system_name() + "::run_time";
+          system.stats.plot_name_match_ratio = system.get_system_name() + "::match_ratio";
+        }
+        TRACY_PLOT(system.stats.plot_name_run_time.c_str(), (int64_t)run.run_time.count());
+        TRACY_PLOT(system.stats.plot_name_match_ratio.c_str(), run.match_ratio());
+      }
+
+      /// \brief Create the tasks for the parallel mode: one start task and one end task per system
+      /// The start task of a system depends on the end tasks of the systems it depends on
+      void push_parallel_tasks(database_t& db, threading::task_manager& tm, threading::task& final_task)
+      {
+        TRACY_SCOPED_ZONE;
+
+        const threading::group_t group = final_task.get_task_group();
+        std::vector<threading::task_wrapper> end_tasks;
+        end_tasks.reserve(systems.size());
+        for (uint32_t i = 0; i < systems.size(); ++i)
+        {
+          end_tasks.push_back(tm.get_task(group, [this, i]()
+          {
+            end_system(*systems[i]);
+          }));
+          final_task.add_dependency_to(*end_tasks.back());
+        }
+
+        for (uint32_t i = 0; i < systems.size(); ++i)
+        {
+          threading::task_wrapper start_task = tm.get_task(group, [this, i, &db, &tm, &end_task = *end_tasks[i]]()
+          {
+            base_system<DatabaseConf>& system = *systems[i];
+            begin_system(system);
+            dispatch_system(system, db, tm, end_task);
+          });
+          end_tasks[i]->add_dependency_to(*start_task);
+
+          for (const uint32_t dep : dependencies[i])
+            start_task->add_dependency_to(*end_tasks[dep]);
+        }
+      }
+
+      /// \brief Sequential modes: run a level of sync_levels, then sync and run the next one, ...
       void sync_point(bool initial, database_t& db, threading::task_manager& tm, threading::task& final_task)
       {
         TRACY_SCOPED_ZONE;
+        const std::vector<std::vector<uint32_t>>& current_levels = *sync_levels;
         if (initial)
         {
-          system_index = 0;
+          level_index = 0;
         }
         else
         {
-          systems[system_index]->end();
-          ++system_index;
+          for (const uint32_t it : current_levels[level_index])
+            end_system(*systems[it]);
+          ++level_index;
         }
 
-        index.store(0, std::memory_order_release);
-
-        // add the task for the next system
-        if (system_index < systems.size())
+        // add the task for the next level
+        if (level_index < current_levels.size())
         {
-          systems[system_index]->init_system_for_run();
-          systems[system_index]->begin();
+          const std::vector<uint32_t>& level = current_levels[level_index];
+          for (const uint32_t it : level)
+            begin_system(*systems[it]);
 
           // create the final sync task:
           threading::task_wrapper next_sync_wr = tm.get_task(final_task.get_task_group(), [this, &db, &tm, &final_task]()
@@ -194,120 +620,694 @@ namespace neam::enfield
 
           final_task.add_dependency_to(*next_sync_wr);
 
-          uint32_t entity_count = 0;
-          if constexpr (DatabaseConf::use_attached_object_db)
+          // a single system can use its own iteration scheme
+          if (level.size() == 1)
+            dispatch_system(*systems[level.front()], db, tm, *next_sync_wr);
+          else
+            dispatch_systems(level, *fused_passes[level_index], db, tm, *next_sync_wr);
+        }
+      }
+
+      /// \brief Return the number of entries a system will iterate over
+      uint32_t get_entry_count(const base_system<DatabaseConf>& system, database_t& db) const
+      {
+        if constexpr (DatabaseConf::use_attached_object_db)
+        {
+          if (system.use_active_set && system.should_use_attached_object_db)
+            return db.get_active_attached_object_count(system.smallest_attached_object_db);
+          if (system.should_use_attached_object_db || !DatabaseConf::use_entity_db)
+            return db.get_attached_object_count(system.smallest_attached_object_db);
+        }
+        if constexpr (DatabaseConf::use_entity_db)
+          return db.get_entity_count();
+        return 0;
+      }
+
+      /// \brief Return the number of tasks to dispatch, limited to avoid saturating the task system
+      uint32_t get_dispatch_count(uint32_t entry_count, uint32_t entity_per_task, uint32_t task_count_limit) const
+      {
+        const uint32_t dispatch_count = (entry_count + entity_per_task - 1) / entity_per_task;
+        return std::min(dispatch_count, task_count_limit != 0 ? task_count_limit : max_task_count);
+      }
+
+      /// \brief Create the worker tasks that will run a single system over every entity
+      /// \param sync The task that will be run once the system has been run over every entity
+      void dispatch_system(base_system<DatabaseConf>& system, database_t& db, threading::task_manager& tm, threading::task& sync)
+      {
+        if (!system.frame_active)
+          return;
+
+        if constexpr (DatabaseConf::use_attached_object_db)
+        {
+          if (system.use_active_set && system.should_use_attached_object_db)
+            db.enable_active_set(system.smallest_attached_object_db);
+        }
+
+        system.cost.update();
+        system.dispatch_entity_per_task = system.entity_per_task != 0 ? system.entity_per_task
+                                          : system.cost.get_entry_count_for(target_task_duration, k_default_entity_per_task,
+                                                                            k_min_entity_per_task, k_max_entity_per_task);
+
+        // only the window of the frame is iterated over (see base_system::time_budget)
+        update_window(system, get_entry_count(system, db), system.cost);
+        const uint32_t entity_count = std::min(system.window_size, system.window_domain_size);
+
+        // create the worker tasks:
+        const uint32_t dispatch_count = get_dispatch_count(entity_count, system.dispatch_entity_per_task, system.max_task_count);
+        system.run_loop.dispatch(tm, sync, dispatch_count, system.dispatch_entity_per_task, use_worker_ranges,
+                                 [this, &system, &db]() { return std::min(system.window_size, get_entry_count(system, db)); },
+                                 [this, &system, &db](uint32_t begin, uint32_t end, uint32_t worker_index)
+        {
+          run_system(system, db, begin, end, worker_index);
+        });
+      }
+
+      /// \brief Compute the entries a fused pass will iterate over
+      ///
+      /// When all the systems of the pass use the attached-object db, the pass can iterate over:
+      ///  - the smallest list of an attached object required by all the systems (intersection of the domains)
+      ///  - the union of the smallest lists of each systems
+      ///  - the entity list
+      /// whichever has the fewest live entries.
+      void compute_fused_domain(const std::vector<uint32_t>& system_list, fused_pass_t& pass, database_t& db)
+      {
+        pass.domain.clear();
+        pass.domain_offsets.clear();
+        pass.skip_masks.clear();
+
+        if constexpr (DatabaseConf::use_attached_object_db)
+        {
+          if (system_list.empty())
+            return;
+
+          inline_mask<DatabaseConf> common_mask = systems[system_list.front()]->mask;
+          std::vector<type_t> union_domain;
+          size_t union_count = 0;
+          for (const uint32_t it : system_list)
           {
-            if (systems[system_index]->should_use_attached_object_db || !DatabaseConf::use_entity_db)
+            const base_system<DatabaseConf>& system = *systems[it];
+            if (!system.should_use_attached_object_db && DatabaseConf::use_entity_db)
+              return;
+            // the system matches every entity
+            if (system.smallest_attached_object_db == ~type_t(0))
+              return;
+
+            for (size_t j = 0; j < inline_mask<DatabaseConf>::entry_count; ++j)
+              common_mask.mask[j] &= system.mask.mask[j];
+
+            if (std::find(union_domain.begin(), union_domain.end(), system.smallest_attached_object_db) == union_domain.end())
             {
-              entity_count = db.get_attached_object_count(systems[system_index]->smallest_attached_object_db);
+              union_domain.push_back(system.smallest_attached_object_db);
+              union_count += db.get_live_attached_object_count(system.smallest_attached_object_db);
             }
-            else if (!systems[system_index]->should_use_attached_object_db)
+          }
+
+          type_t intersection_type = ~type_t(0);
+          size_t intersection_count = ~size_t(0);
+          for (size_t j = 0; j < inline_mask<DatabaseConf>::entry_count; ++j)
+          {
+            for (uint64_t bits = common_mask.mask[j]; bits != 0; bits &= bits - 1)
             {
-              if constexpr (DatabaseConf::use_entity_db)
-                entity_count = db.get_entity_count();
+              const type_t id = j * 64 + std::countr_zero(bits);
+              const size_t count = db.get_live_attached_object_count(id);
+              if (count < intersection_count)
+              {
+                intersection_count = count;
+                intersection_type = id;
+              }
             }
           }
-          else if constexpr (DatabaseConf::use_entity_db)
-          {
+
+          size_t entity_count = ~size_t(0);
+          if constexpr (DatabaseConf::use_entity_db)
             entity_count = db.get_entity_count();
+
+          if (intersection_count <= union_count && intersection_count < entity_count)
+          {
+            pass.domain.push_back(intersection_type);
+            pass.skip_masks.emplace_back();
+          }
+          else if (union_count < entity_count)
+          {
+            pass.domain = std::move(union_domain);
+            inline_mask<DatabaseConf> skip_mask;
+            for (const type_t id : pass.domain)
+            {
+              pass.skip_masks.push_back(skip_mask);
+              skip_mask.set(id);
+            }
+          }
+          else
+          {
+            return;
+          }
+
+          uint32_t offset = 0;
+          for (const type_t id : pass.domain)
+          {
+            pass.domain_offsets.push_back(offset);
+            offset += db.get_attached_object_count(id);
+          }
+          pass.domain_offsets.push_back(offset);
+        }
+      }
+
+      /// \brief Return the number of entries a fused pass iterates over
+      uint32_t get_entry_count(const fused_pass_t& pass, database_t& db) const
+      {
+        if (!pass.domain.empty())
+          return pass.domain_offsets.back();
+        if constexpr (DatabaseConf::use_entity_db)
+          return db.get_entity_count();
+        return 0;
+      }
+
+      /// \brief Compute the chunk size of a fused pass and resize its match cache
+      /// \return The limit of the number of tasks for the pass (0 if none)
+      uint32_t prepare_fused_pass(const std::vector<uint32_t>& system_list, fused_pass_t& pass, uint32_t entry_count)
+      {
+        // the smallest value of the systems wins:
+        uint32_t entity_per_task = 0;
+        uint32_t task_count_limit = 0;
+        pass.has_batch_system = false;
+        for (const uint32_t it : system_list)
+        {
+          pass.has_batch_system = pass.has_batch_system || systems[it]->has_batch_entry_point;
+          if (systems[it]->entity_per_task != 0 && (entity_per_task == 0 || systems[it]->entity_per_task < entity_per_task))
+            entity_per_task = systems[it]->entity_per_task;
+          if (systems[it]->max_task_count != 0 && (task_count_limit == 0 || systems[it]->max_task_count < task_count_limit))
+            task_count_limit = systems[it]->max_task_count;
+        }
+
+        // systems of a pass processed entity by entity are not timed individually
+        for (const uint32_t it : system_list)
+          systems[it]->stats.shared_run_time = !pass.has_batch_system && system_list.size() > 1;
+
+        // execution policies: (the window of the systems that are not timed individually is sized from the cost of the pass)
+        for (const uint32_t it : system_list)
+          update_window(*systems[it], entry_count, systems[it]->cost.cost_per_entry_ns > 0 ? systems[it]->cost : pass.cost);
+
+        pass.cost.update();
+        pass.entity_per_task = entity_per_task != 0 ? entity_per_task
+                               : pass.cost.get_entry_count_for(target_task_duration, k_default_entity_per_task,
+                                                               k_min_entity_per_task, k_max_entity_per_task);
+
+        // entries of entities that moved (db optimization) or were removed are invalidated by the entity check
+        if (system_list.size() <= k_max_cached_system_count)
+          pass.match_cache.resize(entry_count);
+
+        return task_count_limit;
+      }
+
+      /// \brief Create the worker tasks that will run every entity through a list of systems
+      /// \param sync The task that will be run once every entity has been through the systems
+      void dispatch_systems(const std::vector<uint32_t>& system_list, fused_pass_t& pass, database_t& db, threading::task_manager& tm, threading::task& sync)
+      {
+        // no system of the pass runs this frame (see base_system::frame_interval)
+        if (std::none_of(system_list.begin(), system_list.end(), [this](uint32_t it) { return systems[it]->frame_active; }))
+          return;
+
+        compute_fused_domain(system_list, pass, db);
+        const uint32_t entry_count = get_entry_count(pass, db);
+        const uint32_t task_count_limit = prepare_fused_pass(system_list, pass, entry_count);
+
+        const uint32_t dispatch_count = get_dispatch_count(entry_count, pass.entity_per_task, task_count_limit);
+        pass.run_loop.dispatch(tm, sync, dispatch_count, pass.entity_per_task, use_worker_ranges,
+                               [this, &pass, &db]() { return get_entry_count(pass, db); },
+                               [this, &system_list, &pass, &db](uint32_t begin, uint32_t end, uint32_t worker_index)
+        {
+          run_systems(system_list, pass, db, begin, end, worker_index);
+        });
+      }
+
+      /// \brief Create the worker tasks of the pipelined mode
+      /// Every level of the schedule is a stage of the pipeline, and all stages use the same chunks of the entity list.
+      void dispatch_pipeline(database_t& db, threading::task_manager& tm, threading::task& sync)
+      {
+        if constexpr (DatabaseConf::use_entity_db)
+        {
+          const uint32_t stage_count = levels.size();
+          const uint32_t entry_count = db.get_entity_count();
+
+          // all the stages must use the same chunks:
+          uint32_t chunk_size = k_max_entity_per_task;
+          uint32_t task_count_limit = max_task_count;
+          pipeline.neighbour_chunks.assign(stage_count, 0);
+          for (uint32_t stage = 0; stage < stage_count; ++stage)
+          {
+            fused_pass_t& pass = *fused_passes[stage];
+            pass.domain.clear();
+            pass.domain_offsets.clear();
+            pass.skip_masks.clear();
+            const uint32_t stage_task_limit = prepare_fused_pass(levels[stage], pass, entry_count);
+            chunk_size = std::min(chunk_size, pass.entity_per_task);
+            if (stage_task_limit != 0)
+              task_count_limit = std::min(task_count_limit, stage_task_limit);
+
+            for (const uint32_t it : levels[stage])
+              pipeline.neighbour_chunks[stage] = std::max(pipeline.neighbour_chunks[stage], systems[it]->pipeline_neighbour_chunks);
           }
-          // create the worker tasks:
-          uint32_t dispatch_count = entity_count / entity_per_task;
-          if (dispatch_count > max_task_count)
-            dispatch_count = max_task_count;
-          for (uint32_t i = 0; i < dispatch_count; ++i)
+          // a stage must also wait for the chunks the previous stage may read from before writing to a chunk
+          for (uint32_t stage = stage_count; stage-- > 1;)
+            pipeline.neighbour_chunks[stage] = std::max(pipeline.neighbour_chunks[stage], pipeline.neighbour_chunks[stage - 1]);
+
+          pipeline.entry_count = entry_count;
+          pipeline.chunk_size = chunk_size;
+          pipeline.chunk_count = (entry_count + chunk_size - 1) / chunk_size;
+          if (pipeline.chunk_count == 0)
+            return;
+
+          if (pipeline.chunk_count > pipeline.chunk_capacity)
+          {
+            pipeline.completed_stages = std::make_unique<std::atomic<uint32_t>[]>(pipeline.chunk_count);
+            pipeline.chunk_capacity = pipeline.chunk_count;
+          }
+          for (uint32_t i = 0; i < pipeline.chunk_count; ++i)
+            pipeline.completed_stages[i].store(0, std::memory_order_relaxed);
+
+          if (stage_count > pipeline.stage_capacity)
+          {
+            pipeline.next_chunks = std::make_unique<std::atomic<uint32_t>[]>(stage_count);
+            pipeline.stage_capacity = stage_count;
+          }
+          for (uint32_t i = 0; i < stage_count; ++i)
+            pipeline.next_chunks[i].store(0, std::memory_order_relaxed);
+
+          // workers don't wait for the chunks they depend on: they leave and are re-dispatched by the worker that completes them
+          const uint32_t worker_count = std::min(pipeline.chunk_count, task_count_limit);
+          pipeline.free_worker_indices.clear();
+          for (uint32_t i = worker_count; i-- > 0;)
+            pipeline.free_worker_indices.push_back(i);
+          pipeline.tm = &tm;
+          pipeline.sync = &sync;
+
+          for (uint32_t i = 0; i < worker_count; ++i)
+            try_dispatch_pipeline_worker(db);
+        }
+      }
+
+      /// \brief Dispatch a new worker of the pipelined mode, if there's a free worker slot
+      /// \note must be called either before the sync task is dispatched or from a task the sync task depends on
+      void try_dispatch_pipeline_worker(database_t& db)
+      {
+        uint32_t worker_index;
+        {
+          std::lock_guard _lg(spinlock_exclusive_adapter::adapt(pipeline.worker_indices_lock));
+          if (pipeline.free_worker_indices.empty())
+            return;
+          worker_index = pipeline.free_worker_indices.back();
+          pipeline.free_worker_indices.pop_back();
+        }
+
+        threading::task_wrapper task = pipeline.tm->get_task(pipeline.sync->get_task_group(), [this, &db, worker_index]()
+        {
+          run_pipeline(db, worker_index);
+        });
+        pipeline.sync->add_dependency_to(*task);
+      }
+
+      /// \brief Return whether a chunk of any stage can be processed
+      bool has_ready_chunk() const
+      {
+        for (uint32_t stage = 0; stage < levels.size(); ++stage)
+        {
+          const uint32_t chunk = pipeline.next_chunks[stage].load(std::memory_order_acquire);
+          if (chunk < pipeline.chunk_count && is_chunk_ready(stage, chunk))
+            return true;
+        }
+        return false;
+      }
+
+      /// \brief Return whether a chunk can go through a stage
+      bool is_chunk_ready(uint32_t stage, uint32_t chunk) const
+      {
+        const uint32_t neighbours = pipeline.neighbour_chunks[stage];
+        const uint32_t first = chunk > neighbours ? chunk - neighbours : 0;
+        const uint32_t last = std::min(chunk + neighbours, pipeline.chunk_count - 1);
+        for (uint32_t i = first; i <= last; ++i)
+        {
+          if (pipeline.completed_stages[i].load(std::memory_order_acquire) < stage)
+            return false;
+        }
+        return true;
+      }
+
+      /// \brief Worker loop of the pipelined mode: grab the next ready chunk of a stage, run it, repeat
+      /// When nothing is ready, the worker leaves instead of waiting: the chunks it would wait for are being processed
+      /// by other workers, and those will either process the chunks they unlock or dispatch new workers for them.
+      void run_pipeline(database_t& db, uint32_t worker_index)
+      {
+        TRACY_SCOPED_ZONE;
+        const uint32_t stage_count = levels.size();
+
+        bool has_run = true;
+        while (has_run)
+        {
+          has_run = false;
+          // favour the later stages, so chunks go through the whole pipeline as soon as possible
+          for (uint32_t stage = stage_count; stage-- > 0 && !has_run;)
           {
-            threading::task_wrapper task = tm.get_task(final_task.get_task_group(), [this, &db, &tm, &next_sync = *next_sync_wr]() { run_sync_exec(db, tm, next_sync); });
-            next_sync_wr->add_dependency_to(*task);
+            uint32_t chunk = pipeline.next_chunks[stage].load(std::memory_order_acquire);
+            if (chunk >= pipeline.chunk_count || !is_chunk_ready(stage, chunk))
+              continue;
+            if (!pipeline.next_chunks[stage].compare_exchange_strong(chunk, chunk + 1, std::memory_order_acq_rel))
+              continue;
+
+            const uint32_t begin = chunk * pipeline.chunk_size;
+            const uint32_t end = std::min(begin + pipeline.chunk_size, pipeline.entry_count);
+            run_systems(levels[stage], *fused_passes[stage], db, begin, end, worker_index);
+
+            pipeline.completed_stages[chunk].store(stage + 1, std::memory_order_release);
+            has_run = true;
+
+            // the chunk may have unlocked more work than this worker can process: wake an idle worker slot
+            if (has_ready_chunk())
+              try_dispatch_pipeline_worker(db);
           }
         }
+
+        // release the worker slot. A chunk that becomes ready after this point is unlocked by a worker that is still running,
+        // which will process it itself.
+        std::lock_guard _lg(spinlock_exclusive_adapter::adapt(pipeline.worker_indices_lock));
+        pipeline.free_worker_indices.push_back(worker_index);
+      }
+
+      /// \brief Per-thread buffers, to gather entities
+      template<uint32_t Index>
+      static std::vector<entity_data_t*>& get_thread_buffer()
+      {
+        thread_local std::vector<entity_data_t*> buffer;
+        return buffer;
+      }
+
+      /// \brief Per-thread buffers, to gather entry indices
+      static std::vector<uint32_t>& get_thread_index_buffer()
+      {
+        thread_local std::vector<uint32_t> buffer;
+        return buffer;
       }
 
-      void run_sync_exec(database_t& db, threading::task_manager& tm, threading::task& next_sync)
+      /// \brief Run a system on an entity (if the entity has the required attached objects)
+      static void try_run(base_system<DatabaseConf>& system, entity_data_t& data, uint32_t worker_index)
+      {
+        if (system.matches(data))
+        {
+          ++system.stats.worker_slots[worker_index].matched_entities;
+          system.run(data, worker_index);
+        }
+      }
+
+      /// \brief Run a system on an entry of a fused pass (if the entry is selected by the execution policies of the system)
+      static void try_run(base_system<DatabaseConf>& system, uint32_t entry_index, entity_data_t& data, uint32_t worker_index)
+      {
+        if (!system.has_entry_filter || is_selected(system, entry_index, data))
+          try_run(system, data, worker_index);
+      }
+
+      /// \brief Account for a processed chunk in the statistics of a system
+      static void add_chunk_stats(base_system<DatabaseConf>& system, uint32_t worker_index, uint32_t entry_count, std::chrono::steady_clock::duration duration)
+      {
+        system_stats_state_t::worker_slot_t& slot = system.stats.worker_slots[worker_index];
+        slot.run_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(duration).count();
+        slot.visited_entities += entry_count;
+        ++slot.chunk_count;
+      }
+
+      /// \brief Run a system over a chunk of entries
+      void run_system(base_system<DatabaseConf>& system, database_t& db, uint32_t begin, uint32_t end, uint32_t worker_index)
       {
         TRACY_SCOPED_ZONE;
-        check::debug::n_assert(system_index < systems.size(), "Invalid system index");
+        const auto start = std::chrono::steady_clock::now();
 
-        const uint32_t base_index = index.fetch_add(entity_per_task);
+        // with a batch entry point, the matching entities of the chunk are gathered then passed to the system in one call
+        std::vector<entity_data_t*>& batch = get_thread_buffer<0>();
+        batch.clear();
+        const auto visit = [&system, &batch, worker_index](entity_data_t& data)
+        {
+          if (system.bucket_count > 1 && base_system<DatabaseConf>::get_bucket(data, system.bucket_count) != system.current_bucket)
+            return;
+          // (woken-up entities are only in the active set after the next apply_component_db_changes)
+          if (system.use_active_set && data.sleeping.load(std::memory_order_relaxed))
+            return;
+          if (!system.has_batch_entry_point)
+            try_run(system, data, worker_index);
+          else if (system.matches(data))
+            batch.push_back(&data);
+        };
 
-        // for each entities, run all systems:
-        base_system<DatabaseConf>& system = *systems[system_index];
+        // for each entities, run the system:
         if (!DatabaseConf::use_attached_object_db || system.should_use_attached_object_db == false)
         {
           std::lock_guard _lg(spinlock_shared_adapter::adapt(db.entity_list_lock));
+          // the chunk was computed at dispatch time, the entity list may have been compacted since then
+          const uint32_t entity_count = db.get_entity_count();
 
-          // iterate over all entities:
-          for (uint32_t i = 0; i < entity_per_task && base_index + i < db.get_entity_count(); ++i)
+          // iterate over all entities (of the window):
+          for (uint32_t i = begin; i < end; ++i)
           {
-            entity_data_t* data = db.get_entity(base_index + i);
+            const uint32_t entry_index = get_window_entry_index(system, i);
+            if (entry_index >= entity_count)
+              continue;
+            entity_data_t* data = db.get_entity(entry_index);
             if (data != nullptr)
-              system.try_run(*data);
-          }
-
-          // not completed yet: we need more tasks:
-          if (index < db.get_entity_count())
-          {
-            threading::task_wrapper task = tm.get_task(next_sync.get_task_group(), [this, &db, &tm, &next_sync]() { run_sync_exec(db, tm, next_sync); });
-            next_sync.add_dependency_to(*task);
+              visit(*data);
           }
+          if (!batch.empty())
+            system.run_batch(batch, worker_index);
         }
         else // should_use_attached_object_db == true
         {
           if constexpr (DatabaseConf::use_attached_object_db) // only there to delete the code
           {
-            // iterate over all entities:
-            for (uint32_t i = 0; i < entity_per_task && base_index + i < db.get_attached_object_count(system.smallest_attached_object_db); ++i)
+            const uint32_t entry_count = system.use_active_set ? db.get_active_attached_object_count(system.smallest_attached_object_db)
+                                         : db.get_attached_object_count(system.smallest_attached_object_db);
+
+            // iterate over all entities (of the window):
+            for (uint32_t i = begin; i < end; ++i)
             {
-              entity_data_t* data = db.get_attached_object_owner(base_index + i, system.smallest_attached_object_db);
+              const uint32_t entry_index = get_window_entry_index(system, i);
+              if (entry_index >= entry_count)
+                continue;
+              entity_data_t* data = system.use_active_set ? db.get_active_attached_object_owner(entry_index, system.smallest_attached_object_db)
+                                    : db.get_attached_object_owner(entry_index, system.smallest_attached_object_db);
               if (!data) continue;
 
-              system.try_run(*data);
+              visit(*data);
+            }
+            if (!batch.empty())
+              system.run_batch(batch, worker_index);
+          }
+        }
+        system.stats.worker_slots[worker_index].matched_entities += batch.size();
+
+        const auto duration = std::chrono::steady_clock::now() - start;
+        system.cost.add_chunk(duration, end - begin);
+        add_chunk_stats(system, worker_index, end - begin, duration);
+      }
+
+      /// \brief Run a chunk of entries through a list of systems (in the order of the list)
+      void run_systems(const std::vector<uint32_t>& system_list, fused_pass_t& pass, database_t& db, uint32_t begin, uint32_t end, uint32_t worker_index)
+      {
+        TRACY_SCOPED_ZONE;
+        const auto start = std::chrono::steady_clock::now();
+
+        // with batch entry points, the entities of the chunk are gathered then processed system by system
+        std::vector<entity_data_t*>& chunk_entities = get_thread_buffer<1>();
+        std::vector<uint32_t>& chunk_indices = get_thread_index_buffer();
+        chunk_entities.clear();
+        chunk_indices.clear();
+        const auto visit = [this, &system_list, &pass, &chunk_entities, &chunk_indices, worker_index](uint32_t entry_index, entity_data_t& data)
+        {
+          if (pass.has_batch_system)
+          {
+            chunk_entities.push_back(&data);
+            chunk_indices.push_back(entry_index);
+          }
+          else
+            run_systems_on_entity(system_list, pass, entry_index, data, worker_index);
+        };
+
+        if (pass.domain.empty())
+        {
+          if constexpr (DatabaseConf::use_entity_db)
+          {
+            std::lock_guard _lg(spinlock_shared_adapter::adapt(db.entity_list_lock));
+            // the chunk was computed at dispatch time, the entity list may have been compacted since then
+            const uint32_t entity_count = std::min<uint32_t>(end, db.get_entity_count());
+            // for each entities, run all systems:
+            for (uint32_t i = begin; i < entity_count; ++i)
+            {
+              entity_data_t* data = db.get_entity(i);
+              if (data != nullptr)
+                visit(i, *data);
+            }
+            if (!chunk_entities.empty())
+              run_systems_batched(system_list, chunk_entities, chunk_indices, worker_index);
+          }
+        }
+        else
+        {
+          if constexpr (DatabaseConf::use_attached_object_db)
+          {
+            // for each entries of the domain, run all systems:
+            uint32_t list_index = 0;
+            for (uint32_t i = begin; i < end; ++i)
+            {
+              while (i >= pass.domain_offsets[list_index + 1])
+                ++list_index;
+
+              entity_data_t* data = db.get_attached_object_owner(i - pass.domain_offsets[list_index], pass.domain[list_index]);
+              if (data != nullptr && !pass.skip_masks[list_index].intersects(data->mask))
+                visit(i, *data);
             }
+            if (!chunk_entities.empty())
+              run_systems_batched(system_list, chunk_entities, chunk_indices, worker_index);
+          }
+        }
 
-            // not completed yet: we need more tasks:
-            if (index < db.get_attached_object_count(system.smallest_attached_object_db))
+        const auto duration = std::chrono::steady_clock::now() - start;
+        pass.cost.add_chunk(duration, end - begin);
+        // (when processed system by system, the time is accounted by run_systems_batched)
+        for (const uint32_t it : system_list)
+        {
+          if (systems[it]->frame_active)
+            add_chunk_stats(*systems[it], worker_index, end - begin, pass.has_batch_system ? std::chrono::steady_clock::duration(0) : duration);
+        }
+      }
+
+      /// \brief Run a chunk of entities through a list of systems, system by system
+      /// (the order of the systems is respected for each entity)
+      /// \param entry_indices The entry indices of the entities (for the execution policies of the systems)
+      void run_systems_batched(const std::vector<uint32_t>& system_list, std::span<entity_data_t*> entities,
+                               std::span<const uint32_t> entry_indices, uint32_t worker_index)
+      {
+        std::vector<entity_data_t*>& batch = get_thread_buffer<0>();
+        for (const uint32_t it : system_list)
+        {
+          base_system<DatabaseConf>& system = *systems[it];
+          if (!system.frame_active)
+            continue;
+
+          const auto start = std::chrono::steady_clock::now();
+          if (!system.has_batch_entry_point)
+          {
+            for (uint32_t i = 0; i < entities.size(); ++i)
+              try_run(system, entry_indices[i], *entities[i], worker_index);
+          }
+          else
+          {
+            batch.clear();
+            for (uint32_t i = 0; i < entities.size(); ++i)
             {
-              threading::task_wrapper task = tm.get_task(next_sync.get_task_group(), [this, &db, &tm, &next_sync]() { run_sync_exec(db, tm, next_sync); });
-              next_sync.add_dependency_to(*task);
+              if (system.matches(*entities[i]) && (!system.has_entry_filter || is_selected(system, entry_indices[i], *entities[i])))
+                batch.push_back(entities[i]);
             }
+            if (!batch.empty())
+              system.run_batch(batch, worker_index);
+            system.stats.worker_slots[worker_index].matched_entities += batch.size();
           }
+          system.stats.worker_slots[worker_index].run_time_ns += std::chrono::duration_cast<std::chrono::nanoseconds>(std::chrono::steady_clock::now() - start).count();
         }
       }
 
-      void run_all_systems(database_t& db, threading::task_manager& tm, threading::task& final_task)
+      /// \brief Run an entity through a list of systems (in the order of the list)
+      /// The systems that match an entity are cached (see match_cache_entry_t), so the masks are only tested when they change
+      void run_systems_on_entity(const std::vector<uint32_t>& system_list, fused_pass_t& pass, uint32_t entry_index, entity_data_t& data, uint32_t worker_index)
       {
-        TRACY_SCOPED_ZONE;
-        const uint32_t base_index = index.fetch_add(entity_per_task);
+        const uint32_t system_count = system_list.size();
 
-        std::lock_guard _lg(spinlock_shared_adapter::adapt(db.entity_list_lock));
-        // for each entities, run all systems:
-        for (uint32_t i = 0; i < entity_per_task && base_index + i < db.get_entity_count(); ++i)
+        // no cache for this entity: (too many systems, or entity created during the pass)
+        if (entry_index >= pass.match_cache.size())
         {
-          entity_data_t* data = db.get_entity(base_index + i);
-          if (data != nullptr)
+          for (const uint32_t it : system_list)
+            try_run(*systems[it], entry_index, data, worker_index);
+          return;
+        }
+
+        match_cache_entry_t& entry = pass.match_cache[entry_index];
+        if (entry.entity != &data || entry.mask_version != data.mask_version)
+        {
+          entry.entity = &data;
+          entry.mask_version = data.mask_version;
+          entry.matching_systems = 0;
+          for (uint32_t j = 0; j < system_count; ++j)
           {
-            for (auto& sys : systems)
-              sys->try_run(*data);
+            if (systems[system_list[j]]->matches(data))
+              entry.matching_systems |= uint64_t(1) << j;
           }
         }
 
-        // not completed yet: we need more tasks:
-        if (index < db.get_entity_count())
+        uint32_t next_system = 0;
+        for (uint64_t bits = entry.matching_systems; bits != 0 && entry.mask_version == data.mask_version; bits &= bits - 1)
+        {
+          const uint32_t j = std::countr_zero(bits);
+          base_system<DatabaseConf>& system = *systems[system_list[j]];
+          next_system = j + 1;
+          if (system.has_entry_filter && !is_selected(system, entry_index, data))
+            continue;
+          ++system.stats.worker_slots[worker_index].matched_entities;
+          system.run(data, worker_index);
+        }
+
+        // a system changed the mask of the entity: the remaining systems have to check it
+        if (entry.mask_version != data.mask_version)
         {
-          threading::task_wrapper task = tm.get_task(final_task.get_task_group(), [this, &db, &tm, &final_task]() { run_all_systems(db, tm, final_task); });
-          final_task.add_dependency_to(*task);
+          for (uint32_t j = next_system; j < system_count; ++j)
+            try_run(*systems[system_list[j]], entry_index, data, worker_index);
         }
       }
 
     private:
-      const unsigned max_task_count = (std::thread::hardware_concurrency() + 2) * 2;
-      unsigned entity_per_task = 1024;
+      uint32_t max_task_count = (std::thread::hardware_concurrency() + 2) * 2;
+      std::chrono::nanoseconds target_task_duration = std::chrono::microseconds(250);
+      bool use_worker_ranges = false;
+      uint64_t frame_index = 0;
+      // number of worker slots of the statistics (the maximum number of workers of a pass)
+      uint32_t worker_slot_count = 0;
+
+      // state of the pipelined mode
+      struct
+      {
+        uint32_t entry_count = 0;
+        uint32_t chunk_size = 0;
+        uint32_t chunk_count = 0;
+        // for each stage, the number of neighbour chunks that must have gone through the previous stage
+        std::vector<uint32_t> neighbour_chunks;
+
+        // for each chunk, the number of stages it went through
+        std::unique_ptr<std::atomic<uint32_t>[]> completed_stages;
+        uint32_t chunk_capacity = 0;
+        // for each stage, the next chunk to process
+        std::unique_ptr<std::atomic<uint32_t>[]> next_chunks;
+        uint32_t stage_capacity = 0;
+
+        // worker dispatch (workers that have nothing to do leave, and are re-dispatched when chunks are completed)
+        threading::task_manager* tm = nullptr;
+        threading::task* sync = nullptr;
+        shared_spinlock worker_indices_lock;
+        std::vector<uint32_t> free_worker_indices;
+      } pipeline;
 
-      unsigned system_index = 0;
+      unsigned level_index = 0;
+      // the levels sync_point() goes through (levels or single_system_levels)
+      const std::vector<std::vector<uint32_t>>* sync_levels = nullptr;
 
       std::vector<std::unique_ptr<base_system<DatabaseConf>>> systems;
+      // system type id -> index in systems (k_invalid_index if not there)
+      std::vector<uint32_t> system_lookup;
 
-      alignas(64) std::atomic<uint32_t> index;
+      // the schedule:
+      // topological order of the systems
+      std::vector<uint32_t> order;
+      // for each system, the index of the systems that must have completed before it can run
+      std::vector<std::vector<uint32_t>> dependencies;
+      // systems that can run in the same pass, in topological order
+      std::vector<std::vector<uint32_t>> levels;
+      // one level per system, in topological order (for strict_sequential)
+      std::vector<std::vector<uint32_t>> single_system_levels;
+      // state of the fused passes (one per level, the last one is for the per-entity mode)
+      std::vector<std::unique_ptr<fused_pass_t>> fused_passes;
+      bool schedule_dirty = true;
   };
 } // namespace neam::enfield
 
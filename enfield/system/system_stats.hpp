@@ -0,0 +1,186 @@
+//
+// file : system_stats.hpp
+//
+// created by : agent
+// date: Sun Oct 18 2026 10:00:41 GMT+0000 (UTC)
+//
+//
+// Copyright (c) 2026 agent
+//
+// Permission is hereby granted, free of charge, to any person obtaining a copy
+// of this software and associated documentation files (the "Software"), to deal
+// in the Software without restriction, including without limitation the rights
+// to use, copy, modify, merge, publish, distribute, sublicense, and/or sell
+// copies of the Software, and to permit persons to whom the Software is
+// furnished to do so, subject to the following conditions:
+//
+// The above copyright notice and this permission notice shall be included in all
+// copies or substantial portions of the Software.
+//
+// THE SOFTWARE IS PROVIDED "AS IS", WITHOUT WARRANTY OF ANY KIND, EXPRESS OR
+// IMPLIED, INCLUDING BUT NOT LIMITED TO THE WARRANTIES OF MERCHANTABILITY,
+// FITNESS FOR A PARTICULAR PURPOSE AND NONINFRINGEMENT. IN NO EVENT SHALL THE
+// AUTHORS OR COPYRIGHT HOLDERS BE LIABLE FOR ANY CLAIM, DAMAGES OR OTHER
+// LIABILITY, WHETHER IN AN ACTION OF CONTRACT, TORT OR OTHERWISE, ARISING FROM,
+// OUT OF OR IN CONNECTION WITH THE SOFTWARE OR THE USE OR OTHER DEALINGS IN THE
+// SOFTWARE.
+//
+
+#pragma once
+
+#include <algorithm>
+#include <array>
+#include <chrono>
+#include <cstdint>
+#include <string>
+#include <vector>
+
+namespace neam::enfield
+{
+  /// \brief Statistics of a single run of a system
+  struct system_run_stats_t
+  {
+    /// \brief Time between the start of the run (begin()) and its end (end())
+    std::chrono::nanoseconds wall_time { 0 };
+    /// \brief Time spent processing the entities, cumulated across all the workers
+    /// \note If shared_run_time is true, the system was run in a fused pass and this is the time of the whole pass
+    std::chrono::nanoseconds run_time { 0 };
+    bool shared_run_time = false;
+
+    uint64_t visited_entities = 0;
+    uint64_t matched_entities = 0;
+    uint32_t chunk_count = 0;
+
+    float match_ratio() const
+    {
+      return visited_entities > 0 ? float(matched_entities) / float(visited_entities) : 0.0f;
+    }
+  };
+
+  /// \brief Distribution of a duration over the last runs
+  struct duration_summary_t
+  {
+    std::chrono::nanoseconds average { 0 };
+    std::chrono::nanoseconds p50 { 0 };
+    std::chrono::nanoseconds p95 { 0 };
+    std::chrono::nanoseconds p99 { 0 };
+    std::chrono::nanoseconds max { 0 };
+  };
+
+  /// \brief Statistics of a system, over the last runs
+  struct system_stats_t
+  {
+    std::string name;
+    /// \brief Number of runs the statistics are computed on
+    uint32_t run_count = 0;
+
+    system_run_stats_t last_run;
+
+    duration_summary_t wall_time;
+    duration_summary_t run_time;
+    float average_match_ratio = 0;
+    float average_chunk_count = 0;
+  };
+
+  /// \brief Statistics being collected for a system (per worker, no synchronisation) and the history of the last runs
+  struct system_stats_state_t
+  {
+    static constexpr uint32_t k_history_size = 128;
+
+    /// \brief What a worker collects during a run (only written by that worker)
+    struct alignas(64) worker_slot_t
+    {
+      uint64_t run_time_ns = 0;
+      uint64_t visited_entities = 0;
+      uint64_t matched_entities = 0;
+      uint32_t chunk_count = 0;
+    };
+
+    /// \brief Reset the worker slots (must be called before the workers start)
+    void prepare(uint32_t worker_count)
+    {
+      if (worker_slots.size() < worker_count)
+        worker_slots.resize(worker_count);
+      std::fill(worker_slots.begin(), worker_slots.end(), worker_slot_t{});
+    }
+
+    /// \brief Aggregate the worker slots and push the run in the history (must be called after the workers are done)
+    const system_run_stats_t& finish_run(std::chrono::steady_clock::time_point end_time)
+    {
+      system_run_stats_t run;
+      run.wall_time = std::chrono::duration_cast<std::chrono::nanoseconds>(end_time - start_time);
+      run.shared_run_time = shared_run_time;
+      uint64_t run_time_ns = 0;
+      for (const worker_slot_t& it : worker_slots)
+      {
+        run_time_ns += it.run_time_ns;
+        run.visited_entities += it.visited_entities;
+        run.matched_entities += it.matched_entities;
+        run.chunk_count += it.chunk_count;
+      }
+      run.run_time = std::chrono::nanoseconds(run_time_ns);
+
+      history[history_index] = run;
+      history_index = (history_index + 1) % k_history_size;
+      history_count = std::min(history_count + 1, k_history_size);
+      return history[(history_index + k_history_size - 1) % k_history_size];
+    }
+
+    /// \brief Compute the statistics over the last runs
+    system_stats_t compute(std::string name) const
+    {
+      system_stats_t ret;
+      ret.name = std::move(name);
+      ret.run_count = history_count;
+      if (history_count == 0)
+        return ret;
+
+      ret.last_run = history[(history_index + k_history_size - 1) % k_history_size];
+
+      std::vector<std::chrono::nanoseconds> wall_times;
+      std::vector<std::chrono::nanoseconds> run_times;
+      wall_times.reserve(history_count);
+      run_times.reserve(history_count);
+      for (uint32_t i = 0; i < history_count; ++i)
+      {
+        wall_times.push_back(history[i].wall_time);
+        run_times.push_back(history[i].run_time);
+        ret.average_match_ratio += history[i].match_ratio();
+        ret.average_chunk_count += history[i].chunk_count;
+      }
+      ret.average_match_ratio /= history_count;
+      ret.average_chunk_count /= history_count;
+      ret.wall_time = summarize(wall_times);
+      ret.run_time = summarize(run_times);
+      return ret;
+    }
+
+    static duration_summary_t summarize(std::vector<std::chrono::nanoseconds>& durations)
+    {
+      duration_summary_t ret;
+      std::sort(durations.begin(), durations.end());
+      std::chrono::nanoseconds total { 0 };
+      for (const auto it : durations)
+        total += it;
+      const size_t count = durations.size();
+      ret.average = total / count;
+      ret.p50 = durations[(count - 1) * 50 / 100];
+      ret.p95 = durations[(count - 1) * 95 / 100];
+      ret.p99 = durations[(count - 1) * 99 / 100];
+      ret.max = durations.back();
+      return ret;
+    }
+
+    std::chrono::steady_clock::time_point start_time;
+    bool shared_run_time = false;
+    std::vector<worker_slot_t> worker_slots;
+
+    std::array<system_run_stats_t, k_history_size> history;
+    uint32_t history_index = 0;
+    uint32_t history_count = 0;
+
+    // names of the tracy plots (must outlive the plots)
+    std::string plot_name_run_time;
+    std::string plot_name_match_ratio;
+  };
+} // namespace neam::enfield
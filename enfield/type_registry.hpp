@@ -56,6 +56,7 @@ namespace neam::enfield
     {
       type_t id;
       std::string type_name;
+      uint64_t type_hash; // stable across runs (unlike id)
     };
 
     template<typename Type>
@@ -69,7 +70,7 @@ namespace neam::enfield
         debug_info().resize(object_type_id + 1);
       }
       allocator_info()[object_type_id] = {object_type_id, sizeof(Type), alignof(Type)};
-      debug_info()[object_type_id] = {object_type_id, ct::type_name<Type>.str};
+      debug_info()[object_type_id] = {object_type_id, ct::type_name<Type>.str, ct::type_hash<Type>};
     }
 
     static auto& allocator_info()
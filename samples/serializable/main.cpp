@@ -5,7 +5,14 @@
 // #define N_DISABLE_CHECKS // we don't want anything
 // #define ENFIELD_ENABLE_DEBUG_CHECKS
 
+#include <algorithm>
+#include <span>
+#include <string>
+#include <vector>
+
 #include <ntools/logger/logger.hpp>
+#include <ntools/id/string_id.hpp>
+#include <ntools/_tests/task_manager_helper.hpp>
 
 #include <enfield/enfield.hpp>
 #include <enfield/concept/serializable.hpp> // we need the serializable builtin concept
@@ -109,6 +116,246 @@ N_METADATA_STRUCT(truc)
   >;
 };
 
+/// \brief A trivially copyable data (written as-is in mapped snapshots and compared as raw data in deltas)
+struct position
+{
+  float x = 0;
+  float y = 0;
+  float z = 0;
+};
+
+N_METADATA_STRUCT(position)
+{
+  using member_list = neam::ct::type_list
+  <
+    N_MEMBER_DEF(x),
+    N_MEMBER_DEF(y),
+    N_MEMBER_DEF(z)
+  >;
+};
+
+using position_component = neam::enfield::components::data_holder<db_conf, position, serializable::concept_provider>;
+
+// // // // // // // // // // // // // // // // // // // // // //
+// round-trip checks: serialize entities with every format, deserialize them, and compare the result with the original
+
+using entity_t = neam::enfield::entity<db_conf>;
+
+static bool has_failed = false;
+
+static void expect(bool condition, const char* what)
+{
+  if (condition)
+  {
+    neam::cr::out().debug("round-trip: {}: ok", what);
+  }
+  else
+  {
+    neam::cr::out().error("round-trip: {}: FAILED", what);
+    has_failed = true;
+  }
+}
+
+/// \brief Create entities with a metadata component (truc, which requires truc2), a data_holder and a trivially copyable component
+static std::vector<entity_t> create_entities(neam::enfield::database<db_conf>& db, uint32_t count)
+{
+  std::vector<entity_t> entities;
+  for (uint32_t i = 0; i < count; ++i)
+  {
+    entity_t& entity = entities.emplace_back(db.create_entity());
+    truc& t = entity.add<truc>();
+    t.dummy = (int)i;
+    t.other_dummy = "entity #" + std::to_string(i);
+    entity.get<truc2>()->data = { {(int)i, (int)i * 2}, {-1, (int)i} };
+    entity.add<name_component>().data = "name #" + std::to_string(i);
+    if (i % 2 == 0)
+      entity.add<position_component>().data = { (float)i, 0.5f, -(float)i };
+  }
+  db.apply_component_db_changes();
+  return entities;
+}
+
+static bool is_same_entity(entity_t& a, entity_t& b)
+{
+  const truc* ta = a.get<truc>();
+  const truc* tb = b.get<truc>();
+  if (ta == nullptr || tb == nullptr || ta->dummy != tb->dummy || ta->other_dummy != tb->other_dummy)
+    return false;
+  if (!b.has<truc2>() || a.get<truc2>()->data != b.get<truc2>()->data)
+    return false;
+
+  const name_component* na = a.get<name_component>();
+  const name_component* nb = b.get<name_component>();
+  if (na == nullptr || nb == nullptr || na->data != nb->data)
+    return false;
+
+  const position_component* pa = a.get<position_component>();
+  const position_component* pb = b.get<position_component>();
+  if ((pa == nullptr) != (pb == nullptr))
+    return false;
+  return pa == nullptr || (pa->data.x == pb->data.x && pa->data.y == pb->data.y && pa->data.z == pb->data.z);
+}
+
+/// \brief Whether both lists hold the same entities (in any order, truc::dummy is used to match them)
+static bool is_same_entity_list(std::vector<entity_t>& expected, std::vector<entity_t>& restored)
+{
+  if (expected.size() != restored.size())
+    return false;
+  for (entity_t& it : expected)
+  {
+    const auto match = std::find_if(restored.begin(), restored.end(), [&it](entity_t& r)
+    {
+      return r.has<truc>() && r.get<truc>()->dummy == it.get<truc>()->dummy;
+    });
+    if (match == restored.end() || !is_same_entity(it, *match))
+      return false;
+  }
+  return true;
+}
+
+static void check_snapshot_round_trip()
+{
+  neam::enfield::database<db_conf> src;
+  std::vector<entity_t> entities = create_entities(src, 16);
+
+  neam::rle::status st = neam::rle::status::success;
+  const neam::raw_data data = serializable::snapshot(src, st);
+  expect(st != neam::rle::status::failure, "snapshot: serialization");
+
+  neam::enfield::database<db_conf> dst;
+  std::vector<entity_t> restored = serializable::restore_snapshot(dst, data, st);
+  expect(st != neam::rle::status::failure, "snapshot: deserialization");
+  expect(is_same_entity_list(entities, restored), "snapshot: same entities");
+}
+
+static void check_mapped_snapshot_round_trip()
+{
+  neam::enfield::database<db_conf> src;
+  std::vector<entity_t> entities = create_entities(src, 16);
+
+  neam::rle::status st = neam::rle::status::success;
+  const std::vector<uint8_t> data = serializable::mapped_snapshot(src, st);
+  expect(st != neam::rle::status::failure, "mapped snapshot: serialization");
+
+  neam::enfield::database<db_conf> dst;
+  std::vector<entity_t> restored = serializable::load_mapped_snapshot(dst, std::span<const uint8_t>(data), st);
+  expect(st != neam::rle::status::failure, "mapped snapshot: deserialization");
+  expect(is_same_entity_list(entities, restored), "mapped snapshot: same entities");
+
+  // a truncated snapshot must be rejected:
+  neam::enfield::database<db_conf> truncated_dst;
+  st = neam::rle::status::success;
+  serializable::load_mapped_snapshot(truncated_dst, std::span<const uint8_t>(data).first(data.size() / 2), st);
+  expect(st == neam::rle::status::failure, "mapped snapshot: truncated data is rejected");
+}
+
+static void check_delta_round_trip()
+{
+  neam::enfield::database<db_conf> src;
+  std::vector<entity_t> entities = create_entities(src, 1);
+  entity_t& entity = entities[0];
+  serializable& s = *entity.get<serializable>();
+
+  // the first delta holds everything:
+  neam::rle::status st = neam::rle::status::success;
+  const neam::raw_data full_delta = s.serialize_delta(st);
+  expect(st != neam::rle::status::failure && full_delta.size != 0, "delta: full delta");
+
+  neam::enfield::database<db_conf> dst;
+  entity_t copy = serializable::deserialize_delta(dst, full_delta, st);
+  expect(st != neam::rle::status::failure && is_same_entity(entity, copy), "delta: full delta deserialization");
+
+  // only the changes:
+  entity.get<position_component>()->data.y = 42.0f;
+  entity.get<truc>()->other_dummy = "changed";
+  const neam::raw_data delta = s.serialize_delta(st);
+  expect(st != neam::rle::status::failure && delta.size != 0, "delta: partial delta");
+
+  copy.get<serializable>()->apply_delta(copy, delta, st);
+  expect(st != neam::rle::status::failure && is_same_entity(entity, copy), "delta: partial delta application");
+
+  // a partial delta cannot create an entity (it does not have the baseline):
+  st = neam::rle::status::success;
+  serializable::deserialize_delta(dst, delta, st);
+  expect(st == neam::rle::status::failure, "delta: partial delta without baseline is rejected");
+
+  // nothing changed:
+  st = neam::rle::status::success;
+  const neam::raw_data empty_delta = s.serialize_delta(st);
+  expect(st != neam::rle::status::failure && empty_delta.size == 0, "delta: no changes");
+}
+
+static void check_batch_round_trip()
+{
+  neam::enfield::database<db_conf> src;
+  std::vector<entity_t> entities = create_entities(src, 64);
+
+  neam::enfield::database<db_conf> dst;
+  std::vector<neam::raw_data> serialized;
+  std::vector<entity_t> restored;
+
+  neam::tm_helper_t tmh;
+  neam::threading::task_manager& tm = tmh.tm;
+  {
+    neam::threading::task_group_dependency_tree tgd;
+    tgd.add_task_group("serialization-group"_rid);
+    tmh.setup(2, std::move(tgd));
+  }
+
+  bool has_started = false;
+  tm.set_start_task_group_callback("serialization-group"_rid, [&]()
+  {
+    if (has_started)
+      return;
+    has_started = true;
+
+    const neam::threading::group_t group = tm.get_group_id("serialization-group"_rid);
+    neam::threading::task_wrapper serialize_task = serializable::serialize_batch(tm, group, entities, serialized);
+    neam::threading::task_wrapper deserialize_task = tm.get_task(group, [&, group]()
+    {
+      neam::threading::task_wrapper final_task = serializable::deserialize_batch(tm, group, dst, serialized, restored);
+      neam::threading::task_wrapper stop_task = tm.get_task(group, [&tmh]() { tmh.request_stop(); });
+      stop_task->add_dependency_to(*final_task);
+    });
+    deserialize_task->add_dependency_to(*serialize_task);
+  });
+
+  tmh.enroll_main_thread();
+  tmh.join_all_threads();
+
+  expect(serialized.size() == entities.size(), "batch: serialization");
+  expect(is_same_entity_list(entities, restored), "batch: same entities");
+}
+
+static void check_v1_round_trip()
+{
+  neam::enfield::database<db_conf> src;
+  std::vector<entity_t> entities = create_entities(src, 1);
+  entity_t& entity = entities[0];
+
+  // write the entity in the v1 format:
+  neam::rle::status st = neam::rle::status::success;
+  neam::enfield::concepts::internal::serialized_entity v1;
+  v1.externally_added_components = { neam::ct::type_hash<truc>, neam::ct::type_hash<name_component>, neam::ct::type_hash<position_component> };
+  v1.serialized_components.emplace(neam::ct::type_hash<truc>, neam::rle::serialize(*entity.get<truc>(), &st));
+  v1.serialized_components.emplace(neam::ct::type_hash<truc2>, neam::rle::serialize(entity.get<truc2>()->data, &st));
+  v1.serialized_components.emplace(neam::ct::type_hash<name_component>, neam::rle::serialize(*entity.get<name_component>(), &st));
+  v1.serialized_components.emplace(neam::ct::type_hash<position_component>, neam::rle::serialize(*entity.get<position_component>(), &st));
+  const neam::raw_data v1_data = neam::rle::serialize(v1, &st);
+  expect(st != neam::rle::status::failure, "v1: serialization");
+
+  // read it, then write it back in the current (v2) format:
+  neam::enfield::database<db_conf> dst;
+  entity_t v1_entity = serializable::deserialize(dst, v1_data);
+  expect(is_same_entity(entity, v1_entity), "v1: deserialization");
+
+  const neam::raw_data v2_data = v1_entity.get<serializable>()->serialize(st);
+  expect(st != neam::rle::status::failure && neam::enfield::concepts::internal::is_flat_serialized_entity(v2_data), "v1: serialization as v2");
+
+  entity_t v2_entity = serializable::deserialize(dst, v2_data);
+  expect(is_same_entity(entity, v2_entity), "v1: v2 deserialization");
+}
+
 int main(int, char **)
 {
   neam::cr::get_global_logger().min_severity = neam::cr::logger::severity::debug;
@@ -154,5 +401,13 @@ int main(int, char **)
 
   entity2.get<printable>()->print();
 
-  return 0;
+  // // // // // // // // // // // // // // // // // // // // // //
+
+  check_snapshot_round_trip();
+  check_mapped_snapshot_round_trip();
+  check_delta_round_trip();
+  check_batch_round_trip();
+  check_v1_round_trip();
+
+  return has_failed ? 1 : 0;
 }
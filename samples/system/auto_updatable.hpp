@@ -50,6 +50,20 @@ namespace sample
           friend class auto_updatable;
       };
 
+      using database_t = neam::enfield::database<db_conf>;
+
+      /// \brief The update functions of the provider groups (one entry per concrete provider type)
+      struct provider_group_entry_t
+      {
+        size_t (*get_count)(database_t& db);
+        void (*update)(database_t& db, size_t begin, size_t end);
+      };
+      struct provider_group_list_t
+      {
+        mutable neam::shared_spinlock lock;
+        std::vector<provider_group_entry_t> groups;
+      };
+
     public:
       /// \brief The concept provider class: attached objects that want to be auto-updated inherit from this
       template<typename ConceptProvider>
@@ -58,13 +72,26 @@ namespace sample
         public:
           using auto_updatable_t = concept_provider<ConceptProvider>;
 
-          concept_provider(ConceptProvider& _base) : concept_logic(static_cast<base_t&>(_base)) {}
+          concept_provider(ConceptProvider& _base) : concept_logic(static_cast<base_t&>(_base))
+          {
+            if (add_to_provider_group(*this))
+              register_provider_group<ConceptProvider>(get_base().get_database());
+          }
+
+          ~concept_provider()
+          {
+            remove_from_provider_group(*this);
+          }
 
         private:
-          void _do_update() final { get_base_as<ConceptProvider>().update(); }
+          void _update() { get_base_as<ConceptProvider>().update(); }
+          void _do_update() final { _update(); }
+
+          friend class auto_updatable;
       };
 
       /// \brief The system the auto_updatable concept needs. Please register this in your DB
+      /// (or call update_all() instead, which is faster when there are many providers)
       class system : public neam::enfield::system<db_conf, system>
       {
         public:
@@ -90,7 +117,67 @@ namespace sample
     public:
       auto_updatable(param_t p) : ecs_concept(p) {}
 
+      /// \brief Update every auto-updatable attached object of the database
+      /// Unlike the system, providers are updated type by type (a monomorphic loop per provider type, without virtual calls)
+      /// \warning Providers must not be created or destroyed during the update
+      static void update_all(database_t& db)
+      {
+        TRACY_SCOPED_ZONE;
+        provider_group_list_t& list = db.get_shared_object<provider_group_list_t>();
+        std::lock_guard _lg(neam::spinlock_shared_adapter::adapt(list.lock));
+        for (const provider_group_entry_t& it : list.groups)
+          it.update(db, 0, ~size_t(0));
+      }
+
+      /// \brief Parallel version of update_all: providers of each type are split across multiple tasks
+      /// \return The final task
+      static neam::threading::task_wrapper update_all(database_t& db, neam::threading::task_manager& tm, neam::threading::group_t group_id)
+      {
+        auto final_task = tm.get_task(group_id, []() {});
+
+        provider_group_list_t& list = db.get_shared_object<provider_group_list_t>();
+        std::lock_guard _lg(neam::spinlock_shared_adapter::adapt(list.lock));
+        for (const provider_group_entry_t& it : list.groups)
+        {
+          const size_t count = it.get_count(db);
+          for (size_t begin = 0; begin < count; begin += k_provider_per_task)
+          {
+            auto task = tm.get_task(group_id, [&db, update = it.update, begin]()
+            {
+              update(db, begin, begin + k_provider_per_task);
+            });
+            final_task->add_dependency_to(*task);
+          }
+        }
+        return final_task;
+      }
+
     private:
+      static constexpr size_t k_provider_per_task = 4096;
+
+      template<typename ConceptProvider>
+      static void register_provider_group(database_t& db)
+      {
+        provider_group_list_t& list = db.get_shared_object<provider_group_list_t>();
+        std::lock_guard _lg(neam::spinlock_exclusive_adapter::adapt(list.lock));
+        list.groups.push_back(
+        {
+          [](database_t& db) { return get_provider_group<concept_provider<ConceptProvider>>(db).providers.size(); },
+          &update_provider_group<ConceptProvider>,
+        });
+      }
+
+      template<typename ConceptProvider>
+      static void update_provider_group(database_t& db, size_t begin, size_t end)
+      {
+        TRACY_SCOPED_ZONE;
+        auto& group = get_provider_group<concept_provider<ConceptProvider>>(db);
+        std::lock_guard _lg(neam::spinlock_shared_adapter::adapt(group.lock));
+        end = std::min(end, group.providers.size());
+        for (size_t i = begin; i < end; ++i)
+          group.providers[i]->_update();
+      }
+
       /// \brief Called by the system to update every auto_updatable attached objects
       void update_all()
       {
@@ -115,8 +115,7 @@ int main(int, char **)
         if (frame_index >= frame_count)
           tmh.request_stop();
 
-        size_t sz = 0;
-        db.for_each([&sz](sample::comp_2&, sample::comp_3& ) { ++sz; });
+        const size_t sz = db.count<sample::comp_2, sample::comp_3>();
         if (frame_index <= 2)
           neam::cr::out().debug(" matching comp2/comp3: {}", sz);
         static unsigned old_pct = 0;
@@ -1,20 +1,29 @@
-
 // #include <neam/reflective/reflective.hpp>
 
 // #define N_ALLOW_DEBUG true // we want full debug information
 // #define N_DISABLE_CHECKS // we don't want anything
 // #define ENFIELD_ENABLE_DEBUG_CHECKS
 
+#include <algorithm>
+#include <cstdio>
+#include <string>
+#include <vector>
+
 #include <ntools/logger/logger.hpp>
+#include <ntools/id/string_id.hpp>
+#include <ntools/_tests/task_manager_helper.hpp>
 
 #include <enfield/enfield.hpp>
 #include <enfield/concept/serializable.hpp>
 #include <enfield/component/data_holder.hpp>
+#include <enfield/component/name.hpp>
 #include <enfield/system/system_manager.hpp>
+#include <enfield/journal.hpp>
+#include <enfield/rollback.hpp>
 
 using db_conf = neam::enfield::db_conf::eccs;
 
-using serializable = neam::enfield::concepts::serializable<db_conf, neam::cr::persistence_backend::json>;
+using serializable = neam::enfield::concepts::serializable<db_conf>;
 
 /// \brief Defines the "printable" concept
 class printable : public neam::enfield::ecs_concept<db_conf, printable>
@@ -25,7 +34,7 @@ class printable : public neam::enfield::ecs_concept<db_conf, printable>
     class concept_logic : public ecs_concept::base_concept_logic
     {
       protected:
-        concept_logic(base_t *_base) : ecs_concept::base_concept_logic(_base) {}
+        concept_logic(base_t& _base) : ecs_concept::base_concept_logic(_base) {}
 
         virtual void _do_print() const = 0;
         friend class printable;
@@ -36,7 +45,7 @@ class printable : public neam::enfield::ecs_concept<db_conf, printable>
     class concept_provider : public concept_logic
     {
       public:
-        concept_provider(base_t *_base) : concept_logic(_base) {}
+        concept_provider(ConceptProvider& _base) : concept_logic(static_cast<base_t&>(_base)) {}
 
       private:
         void _do_print() const final { get_base_as<ConceptProvider>().print(); }
@@ -55,7 +64,7 @@ class printable : public neam::enfield::ecs_concept<db_conf, printable>
         get_concept_provider(i)._do_print();
 
       // could also be:
-//       for_each([](const concept_logic &cp)
+//       for_each_concept_provider([](const concept_logic &cp)
 //       {
 //         cp._do_print();
 //       });
@@ -67,7 +76,6 @@ class printable : public neam::enfield::ecs_concept<db_conf, printable>
 };
 
 /// \brief A system
-class truc2;
 class printable_sys : public neam::enfield::system<db_conf, printable_sys>
 {
   private:
@@ -97,21 +105,15 @@ class truc2 : public neam::enfield::component<db_conf, truc2>, private printable
   public:
     truc2(param_t p)
       : component(p),
-        printable::concept_provider<truc2>(this),
-        serializable::concept_provider<truc2>(this)
-    {
-    }
-
-    truc2(param_t p, neam::enfield::concepts::from_deserialization_t)
-      : component(p),
-        printable::concept_provider<truc2>(this),
-        serializable::concept_provider<truc2>(this)
+        printable::concept_provider<truc2>(*this),
+        serializable::concept_provider<truc2>(*this)
     {
-      print("deser !");
-      std::map<int, int> ret = get_persistent_data();
-      for (const auto &it : ret)
+      if (has_persistent_data())
       {
-        neam::get_global_logger().log() << LOGGER_INFO << "  { " << it.first << ", " << it.second << " }" << std::endl;
+        print("deser !");
+        std::map<int, int> ret = get_persistent_data();
+        for (const auto &it : ret)
+          neam::cr::out().log("  {{ {}, {} }}", it.first, it.second);
       }
     }
 
@@ -125,7 +127,7 @@ class truc2 : public neam::enfield::component<db_conf, truc2>, private printable
     ///       all it asks is that you can do a xxx.print(); without causing a compilation error.
     void print(const std::string &hello_message = "howdy") const
     {
-      neam::get_global_logger().log() << LOGGER_INFO << hello_message << ": truc2" << std::endl;
+      neam::cr::out().log("{}: truc2", hello_message);
     }
 
     std::map<int, int> get_data_to_serialize() const
@@ -147,26 +149,17 @@ class truc : public neam::enfield::component<db_conf, truc>,
   public:
     truc(param_t p)
       : component(p),
-        printable::concept_provider<truc>(this),
-        serializable::concept_provider<truc>(this)
+        printable::concept_provider<truc>(*this),
+        serializable::concept_provider<truc>(*this)
     {
       require<truc2>().print("greetings from truc::truc");
     }
 
-    truc(param_t p, neam::enfield::concepts::from_deserialization_t)
-      : component(p),
-        printable::concept_provider<truc>(this),
-        serializable::concept_provider<truc>(this)
-    {
-      require<truc2>(neam::enfield::concepts::from_deserialization_t()).print("greetings from truc::truc");
-      unrequire<truc2>();
-    }
-
     std::string print() const
     {
 //       get_required<truc2>().print("greetings from truc::print");
 
-      neam::get_global_logger().log() << "hello: truc" << std::endl;
+      neam::cr::out().log("hello: truc");
 
       return "truc";
     }
@@ -179,53 +172,259 @@ class truc : public neam::enfield::component<db_conf, truc>,
     }
 };
 
+// // // // // // // // // // // // // // // // // // // // // //
+// journal / rollback checks
 
-int main(int, char **)
+/// \brief A trivially copyable data (copied as-is by the rollback buffer)
+struct counter
+{
+  uint32_t id = 0;
+  int32_t value = 0;
+};
+
+N_METADATA_STRUCT(counter)
+{
+  using member_list = neam::ct::type_list
+  <
+    N_MEMBER_DEF(id),
+    N_MEMBER_DEF(value)
+  >;
+};
+
+using counter_component = neam::enfield::components::data_holder<db_conf, counter, serializable::concept_provider>;
+// not trivially copyable: serialized by the rollback buffer
+using label_component = neam::enfield::components::name<db_conf, serializable::concept_provider>;
+
+/// \brief Requires a label (so the label is not externally added)
+class labelled : public neam::enfield::component<db_conf, labelled>
+{
+  private:
+    using component = neam::enfield::component<db_conf, labelled>;
+  public:
+    labelled(param_t p) : component(p)
+    {
+      require<label_component>();
+    }
+};
+
+using entity_t = neam::enfield::entity<db_conf>;
+
+static bool has_failed = false;
+
+static void expect(bool condition, const char* what)
 {
-  neam::get_global_logger().log_level = neam::cr::stream_logger::verbosity_level::debug;
+  if (condition)
+  {
+    neam::cr::out().debug("test: {}: ok", what);
+  }
+  else
+  {
+    neam::cr::out().error("test: {}: FAILED", what);
+    has_failed = true;
+  }
+}
+
+static void record_state(neam::enfield::journal<db_conf>& jrnl, entity_t& entity)
+{
+  std::lock_guard _lg(neam::spinlock_exclusive_adapter::adapt(entity.get_lock()));
+  jrnl.record_state(entity, true);
+}
+
+/// \brief Record a few frames, replay them in another database and compare the entities
+static void check_journal_replay()
+{
+  const char* const path = "test-dev.journal";
 
   neam::enfield::database<db_conf> db;
-  neam::enfield::system_manager<db_conf> sysmgr;
+  std::vector<entity_t> entities;
+  {
+    neam::enfield::journal<db_conf> jrnl(db, path);
+    expect(jrnl.is_open(), "journal: open");
 
-  sysmgr.add_system<printable_sys>(db);
+    // frame 0: creations (the first delta of an entity holds everything)
+    for (uint32_t i = 0; i < 4; ++i)
+    {
+      entity_t& entity = entities.emplace_back(db.create_entity());
+      entity.add<counter_component>().data = { i, (int32_t)i * 10 };
+      record_state(jrnl, entity);
+    }
+    expect(jrnl.commit(), "journal: commit");
+
+    // frame 1: a change, an added attached object, a removal
+    entities[0].get<counter_component>()->data.value = 100;
+    record_state(jrnl, entities[0]);
+    entities[1].add<label_component>().data = "one";
+    record_state(jrnl, entities[1]);
+    entities.pop_back();
+    expect(jrnl.commit(), "journal: commit");
+
+    // frame 2: a removed attached object, an attached object created by a dependency (truc requires truc2)
+    entities[1].remove<label_component>();
+    entities[2].add<label_component>().data = "two";
+    entities[2].add<truc>();
+    record_state(jrnl, entities[2]);
+    expect(jrnl.commit(), "journal: commit");
+  }
+
+  // simulate a crash while a frame was being written:
+  if (FILE* file = std::fopen(path, "ab"))
+  {
+    const uint8_t garbage[] = { 0x4A, 0x52, 0x4C, 0x33, 0xFF, 0xFF, 0x00, 0x00, 0x01 };
+    std::fwrite(garbage, sizeof(garbage), 1, file);
+    std::fclose(file);
+  }
+
+  neam::enfield::database<db_conf> replay_db;
+  std::unordered_map<uint64_t, entity_t> replayed = neam::enfield::journal<db_conf>::replay(replay_db, path);
+  expect(replayed.size() == entities.size(), "journal: replayed entity count");
+
+  for (entity_t& it : entities)
+  {
+    const counter& expected = it.get<counter_component>()->data;
+    const auto match = std::find_if(replayed.begin(), replayed.end(), [&expected](auto& r)
+    {
+      return r.second.template has<counter_component>() && r.second.template get<counter_component>()->data.id == expected.id;
+    });
+    if (match == replayed.end())
+    {
+      expect(false, "journal: replayed entity");
+      continue;
+    }
 
-  auto entity = db.create_entity();
+    entity_t& replayed_entity = match->second;
+    expect(replayed_entity.get<counter_component>()->data.value == expected.value, "journal: replayed counter");
+    expect(replayed_entity.has<label_component>() == it.has<label_component>(), "journal: replayed attached objects");
+    if (it.has<label_component>() && replayed_entity.has<label_component>())
+      expect(replayed_entity.get<label_component>()->data == it.get<label_component>()->data, "journal: replayed label");
+    expect(replayed_entity.has<truc2>() == it.has<truc2>(), "journal: replayed dependencies");
+    if (it.has<truc2>() && replayed_entity.has<truc2>())
+      expect(!replayed_entity.get<truc2>()->is_externally_added(), "journal: replayed dependencies are not externally added");
+  }
+
+  std::remove(path);
+}
 
-  entity.add<truc>().print();
+/// \brief Capture a frame, change everything, restore the frame and compare
+static void check_rollback_restore()
+{
+  using rollback_buffer_t = neam::enfield::rollback_buffer<db_conf, counter_component, label_component>;
 
-//   entity.get<truc2>()->print();
-//   neam::get_global_logger().log() << "has<printable>: " << std::boolalpha << entity.has<printable>() << std::endl;
+  neam::enfield::database<db_conf> db;
+  rollback_buffer_t rb(db, 8);
+
+  const rollback_buffer_t::entity_id_t id0 = rb.create_entity();
+  rb.get_entity(id0)->add<counter_component>().data = { 0, 10 };
+  const rollback_buffer_t::entity_id_t id1 = rb.create_entity();
+  rb.get_entity(id1)->add<counter_component>().data = { 1, 20 };
+  rb.get_entity(id1)->add<label_component>().data = "one";
+  const rollback_buffer_t::entity_id_t id2 = rb.create_entity();
+  rb.get_entity(id2)->add<counter_component>().data = { 2, 30 };
+
+  const uint64_t frame = rb.capture();
+
+  // simulate a few frames:
+  rb.get_entity(id0)->get<counter_component>()->data.value = 11;
+  rb.get_entity(id0)->add<label_component>().data = "zero";
+  rb.get_entity(id1)->get<label_component>()->data = "changed";
+  rb.get_entity(id2)->add<labelled>(); // the label is owned by labelled: it must not be removed by restore()
+  const rollback_buffer_t::entity_id_t id3 = rb.create_entity();
+  rb.get_entity(id3)->add<counter_component>().data = { 3, 40 };
+  const uint64_t next_frame = rb.capture();
+
+  rb.remove_entity(id1);
+  expect(rb.get_entity(id1) == nullptr, "rollback: removed entity");
+
+  expect(rb.restore(frame), "rollback: restore");
+  expect(!rb.has_frame(next_frame), "rollback: later frames are discarded");
+
+  entity_t* e0 = rb.get_entity(id0);
+  expect(e0 != nullptr && e0->get<counter_component>()->data.value == 10, "rollback: restored data");
+  expect(e0 != nullptr && !e0->has<label_component>(), "rollback: added attached object is removed");
+
+  entity_t* e1 = rb.get_entity(id1);
+  expect(e1 != nullptr, "rollback: removed entity is restored");
+  expect(e1 != nullptr && e1->has<label_component>() && e1->get<label_component>()->data == "one", "rollback: restored serialized data");
+
+  entity_t* e2 = rb.get_entity(id2);
+  expect(e2 != nullptr && e2->has<labelled>() && e2->has<label_component>(), "rollback: required attached object is kept");
+
+  expect(rb.get_entity(id3) == nullptr, "rollback: created entity is removed");
+}
+
+int main(int, char **)
+{
+  neam::cr::get_global_logger().min_severity = neam::cr::logger::severity::debug;
+  neam::cr::get_global_logger().register_callback(neam::cr::print_log_to_console, nullptr);
 
-  neam::cr::raw_data dt;
-  db.for_each([&dt, &db](serializable &s)
   {
-    dt = s.serialize();
-    db.break_for_each();
-//     neam::get_global_logger().log() << (char *)dt.data << std::endl;
-  });
+    neam::enfield::database<db_conf> db;
+    neam::enfield::system_manager<db_conf> sysmgr;
+
+    sysmgr.add_system<printable_sys>(db);
+
+    auto entity = db.create_entity();
+
+    entity.add<truc>().print();
+
+  //   entity.get<truc2>()->print();
+  //   neam::cr::out().log("has<printable>: {}", entity.has<printable>());
+
+    neam::raw_data dt;
+    db.for_each([&dt](serializable &s)
+    {
+      neam::rle::status st = neam::rle::status::success;
+      dt = s.serialize(st);
+      return neam::enfield::for_each::stop;
+    });
+
+    auto entity2 = db.create_entity();
+    serializable::deserialize(entity2, dt);
+
+    // run the systems once:
+    {
+      neam::tm_helper_t tmh;
+      neam::threading::task_manager& tm = tmh.tm;
+      {
+        neam::threading::task_group_dependency_tree tgd;
+        tgd.add_task_group("system-group"_rid);
+        tmh.setup(1, std::move(tgd));
+      }
+
+      tm.set_start_task_group_callback("system-group"_rid, [&sysmgr, &tm, &tmh, &db]()
+      {
+        db.apply_component_db_changes();
+        sysmgr.push_tasks(db, tm, "system-group"_rid, true)
+        .then([&tmh]()
+        {
+          tmh.request_stop();
+        });
+      });
+
+      tmh.enroll_main_thread();
+      tmh.join_all_threads();
+    }
 
-  auto entity2 = db.create_entity();
-  entity2.add<serializable::deserialization_marker>(&entity2, &dt);
-  entity2.remove<serializable::deserialization_marker>();
+    entity.remove<truc>();
 
-  sysmgr.start_new_cycle();
-  sysmgr.run_systems(db);
+    // Will fail the compilation (operation not permitted):
+    // entity.add<printable>();
+    // entity.remove<printable>();
 
-  entity.remove<truc>();
+  //   neam::cr::out().log("has<printable>: {}", entity.has<printable>());
+  //   neam::cr::out().log("has<truc2>: {}", entity.has<truc2>());
 
-  // Will fail the compilation (operation not permitted):
-  // entity.add<printable>();
-  // entity.remove<printable>();
+    entity.add<truc>();
+    entity.add<truc2>();
+    entity.remove<truc>();
 
-//   neam::get_global_logger().log() << "has<printable>: " << std::boolalpha << entity.has<printable>() << std::endl;
-//   neam::get_global_logger().log() << "has<truc2>: " << std::boolalpha << entity.has<truc2>() << std::endl;
+  //   neam::cr::out().log("has<truc2>: {}", entity.has<truc2>());
+  //   neam::cr::out().log("has<printable>: {}", entity.has<printable>());
+  }
 
-  entity.add<truc>();
-  entity.add<truc2>();
-  entity.remove<truc>();
+  // // // // // // // // // // // // // // // // // // // // // //
 
-//   neam::get_global_logger().log() << "has<truc2>: " << std::boolalpha << entity.has<truc2>() << std::endl;
-//   neam::get_global_logger().log() << "has<printable>: " << std::boolalpha << entity.has<printable>() << std::endl;
+  check_journal_replay();
+  check_rollback_restore();
 
-  return 0;
+  return has_failed ? 1 : 0;
 }